@@ -251,6 +251,14 @@ class CV_EXPORTS BinaryDescriptor : public Algorithm
     @param rRatio reduction ratio
      */
   void setReductionRatio( int rRatio );
+  /** @brief Get the max. number of threads the descriptors are computed with
+    */
+  int getMaxThreads() const;
+  /** @brief Set the max. number of threads the descriptors are computed with
+    @param nthreads max. number of threads (1 computes them in the calling thread, a value lower than 1
+    uses all of OpenCV's threads); callers already running in parallel should pass their share of threads
+     */
+  void setMaxThreads( int nthreads );
 
   /** @brief Read parameters from a FileNode object and store them
 
@@ -300,6 +308,18 @@ class CV_EXPORTS BinaryDescriptor : public Algorithm
   void compute( const std::vector<Mat>& images, std::vector<std::vector<KeyLine> >& keylines, std::vector<Mat>& descriptors, bool returnFloatDescr =
                     false ) const;
 
+  /** @overload
+
+    @param octaves Gaussian pyramid of the input image (octaves blurred as in computeSobel)
+    @param dx horizontal Sobel derivatives (CV_16SC1) of each octave
+    @param dy vertical Sobel derivatives (CV_16SC1) of each octave
+    @param keylines vector containing lines for which descriptors must be computed
+    @param descriptors
+    @param returnFloatDescr flag (when set to true, original non-binary descriptors are returned)
+     */
+  void compute( const std::vector<Mat>& octaves, const std::vector<Mat>& dx, const std::vector<Mat>& dy, CV_OUT CV_IN_OUT std::vector<KeyLine>& keylines,
+                CV_OUT Mat& descriptors, bool returnFloatDescr = false ) const;
+
   /** @brief Return descriptor size
    */
   int descriptorSize() const;
@@ -335,6 +355,9 @@ class CV_EXPORTS BinaryDescriptor : public Algorithm
   virtual void computeImpl( const Mat& imageSrc, std::vector<KeyLine>& keylines, Mat& descriptors, bool returnFloatDescr,
                             bool useDetectionData ) const;
 
+  /** computation of the descriptors from the current octaves and derivatives */
+  void computeDescriptors( std::vector<KeyLine>& keylines, Mat& descriptors, bool returnFloatDescr, bool useDetectionData ) const;
+
  //private:
   /** struct to represent lines extracted from an octave */
   struct OctaveLine
@@ -845,6 +868,9 @@ unsigned char binaryConversion( float* f1, float* f2 );
 /* compute LBD descriptors using EDLine extractor */
 int computeLBD( ScaleLines &keyLines, bool useDetectionData = false );
 
+/* compute the LBD descriptor (NUM_OF_BANDS * 8 floats) of a single line */
+void computeLineLBD( const KeyLine& kl, bool useDetectionData, float* desVec ) const;
+
 /* gathers lines in groups using EDLine extractor.
  Each group contains the same line, detected in different octaves */
 int OctaveKeyLines( cv::Mat& image, ScaleLines &keyLines );
@@ -858,6 +884,9 @@ std::vector<double> gaussCoefG_;
 /* descriptor parameters */
 Params params;
 
+/* max. number of threads the descriptors are computed with (lower than 1: all of OpenCV's threads) */
+int maxThreads_;
+
 /* vector of sizes of downsampled and blurred images */
 std::vector<cv::Size> images_sizes;
 
@@ -904,6 +933,8 @@ LSDDetector()
 ;
 
 struct LSDOptions{
+    /* tiling is opt-in: callers that only fill the original fields get a single tile */
+    LSDOptions() : grid_cols( 1 ), grid_rows( 1 ), tile_overlap( 0 ), merge_ang_th( 0 ), merge_dist_th( 0 ) {}
     int    refine;
     double scale;
     double sigma_scale;
@@ -913,6 +944,14 @@ struct LSDOptions{
     double density_th;
     int    n_bins;
     double min_length;
+    /* tiled detection: grid of tiles processed in parallel (1x1 disables it), overlap between
+       neighbouring tiles in pixels, and max. angle (degrees) and distance (pixels) to merge
+       the pieces of a segment split by a seam */
+    int    grid_cols;
+    int    grid_rows;
+    int    tile_overlap;
+    double merge_ang_th;
+    double merge_dist_th;
 } options;
 
 /** @brief Creates ad LSDDetector object, using smart pointers.
@@ -930,6 +969,16 @@ static Ptr<LSDDetector> createLSDDetector();
 void detect( const Mat& image, CV_OUT std::vector<KeyLine>& keylines, int scale, int numOctaves, const Mat& mask = Mat() );
 void detect( const Mat& image, CV_OUT std::vector<KeyLine>& keylines, int scale, int numOctaves, LSDOptions opts, const Mat& mask = Mat() );
 
+/** @overload
+@param pyramid precomputed pyramid of the (grayscale) input image: the image itself followed by its
+successive pyrDown reductions by *scale*
+@param keylines vector that will store extracted lines
+@param scale scale factor used in pyramid generation
+@param opts LSD and tiling options
+@param mask mask matrix to detect only KeyLines of interest
+*/
+void detect( const std::vector<Mat>& pyramid, CV_OUT std::vector<KeyLine>& keylines, int scale, LSDOptions opts, const Mat& mask = Mat() );
+
 
 /** @overload
 @param images input images
@@ -950,6 +999,12 @@ void computeGaussianPyramid( const Mat& image, int numOctaves, int scale );
 void detectImpl( const Mat& imageSrc, std::vector<KeyLine>& keylines, int numOctaves, int scale, const Mat& mask ) const;
 void detectImpl( const Mat& imageSrc, std::vector<KeyLine>& keylines, int numOctaves, int scale, LSDOptions opts, const Mat& mask ) const;
 
+/* line detection on the current pyramid */
+void detectPyramid( std::vector<KeyLine>& keylines, int scale, const LSDOptions& opts, const Mat& mask ) const;
+
+/* tiled line detection on a single image */
+void detectTiled( const Mat& image, std::vector<Vec4f>& lines, const LSDOptions& opts ) const;
+
 /* matrices for Gaussian pyramids */
 std::vector<cv::Mat> gaussianPyrs;
 };
@@ -1094,6 +1149,17 @@ static Ptr<BinaryDescriptorMatcher> createBinaryDescriptorMatcher();
  */
 void clear();
 
+/** @brief Get the max. number of threads the queries are split among
+ */
+int getMaxThreads() const;
+
+/** @brief Set the max. number of threads the queries are split among
+
+@param nthreads max. number of threads (1 runs the queries in the calling thread, a value lower than 1
+uses all of OpenCV's threads); callers already running in parallel should pass their share of threads
+ */
+void setMaxThreads( int nthreads );
+
 /** @brief Constructor.
 
 The BinaryDescriptorMatcher constructed is able to store and manage 256-bits long entries.
@@ -1103,35 +1169,11 @@ BinaryDescriptorMatcher();
 /** destructor */
 ~BinaryDescriptorMatcher()
 {
+  delete dataset;
 }
 
 private:
-class BucketGroup
-{
-
-public:
-/** constructor */
-BucketGroup();
-
-/** destructor */
-~BucketGroup();
-
-/** insert data into the bucket */
-void insert( int subindex, UINT32 data );
-
-/** perform a query to the bucket */
-UINT32* query( int subindex, int *size );
-
-/** utility functions */
-void insert_value( std::vector<uint32_t>& vec, int index, UINT32 data );
-void push_value( std::vector<uint32_t>& vec, UINT32 Data );
-
-/** data fields */
-UINT32 empty;
-std::vector<uint32_t> group;
-
-
-};
+friend class MihasherQueryInvoker;
 
 class SparseHashtable
 {
@@ -1141,8 +1183,11 @@ private:
 /** Maximum bits per key before folding the table */
 static const int MAX_B;
 
-/** Bins (each bin is an Array object for duplicates of the same key) */
-BucketGroup *table;
+/** Position in data of the first entry of every key, plus the total number of entries (CSR layout) */
+std::vector<UINT32> offsets;
+
+/** Indices of the codes, grouped by key and in increasing order within each key */
+std::vector<UINT32> data;
 
 public:
 
@@ -1155,8 +1200,8 @@ SparseHashtable();
 /** initializer */
 int init( int _b );
 
-/** insert data */
-void insert( UINT64 index, UINT32 data );
+/** build the table from the keys of N codes (the key of code i is keys[i * stride]) */
+void build( const UINT64* keys, UINT32 N, int stride );
 
 /** query data */
 UINT32* query( UINT64 index, int* size );
@@ -1164,7 +1209,7 @@ UINT32* query( UINT64 index, int* size );
 /** Bits per index */
 int b;
 
-/**  Number of bins */
+/**  Number of keys */
 UINT64 size;
 
 };
@@ -1263,18 +1308,12 @@ UINT64 N;
 /** Table of original full-length codes */
 cv::Mat codes;
 
-/** Counter for eliminating duplicate results (it is not thread safe) */
-bitarray *counter;
-
 /** Array of m hashtables */
 SparseHashtable *H;
 
 /** Volume of a b-bit Hamming ball with radius s (for s = 0 to d) */
 UINT32 *xornum;
 
-/** Used within generation of binary codes at a certain Hamming distance */
-int power[100];
-
 /** constructor */
 Mihasher();
 
@@ -1290,13 +1329,13 @@ void setK( int K );
 /** populate tables */
 void populate( cv::Mat & codes, UINT32 N, int dim1codes );
 
-/** execute a batch query */
-void batchquery( UINT32 * results, UINT32 *numres/*, qstat *stats*/, const cv::Mat & q, UINT32 numq, int dim1queries );
+/** execute a batch query (split among up to nthreads threads) */
+void batchquery( UINT32 * results, UINT32 *numres/*, qstat *stats*/, const cv::Mat & q, UINT32 numq, int dim1queries, int nthreads );
 
-private:
-
-/** execute a single query */
-void query( UINT32 * results, UINT32* numres/*, qstat *stats*/, UINT8 *q, UINT64 * chunks, UINT32 * res );
+/** execute a single query, with the caller's scratch buffers: chunks (m), res (K * (D + 1)),
+ counter of duplicate results (N bits) and power (locations of the ones of the probed
+ bit-strings, d + 1), so that different threads can query the same tables */
+void query( UINT32 * results, UINT32* numres/*, qstat *stats*/, UINT8 *q, UINT64 * chunks, UINT32 * res, bitarray * counter, int * power );
 };
 
 /** retrieve Hamming distances */
@@ -1320,6 +1359,9 @@ int numImages;
 /** number of descriptors in dataset */
 int descrInDS;
 
+/** max. number of threads the queries are split among (lower than 1: all of OpenCV's threads) */
+int maxThreads;
+
 };
 
 /* --------------------------------------------------------------------------------------------
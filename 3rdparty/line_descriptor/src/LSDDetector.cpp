@@ -58,8 +58,8 @@ void LSDDetector::computeGaussianPyramid( const Mat& image, int numOctaves, int
   /* clear class fields */
   gaussianPyrs.clear();
 
-  /* insert input image into pyramid */
-  cv::Mat currentMat = image.clone();
+  /* insert input image into pyramid (read only, no copy needed) */
+  cv::Mat currentMat = image;
   //cv::GaussianBlur( currentMat, currentMat, cv::Size( 5, 5 ), 1 );
   gaussianPyrs.push_back( currentMat );
 
@@ -214,6 +214,157 @@ void LSDDetector::detectImpl( const Mat& imageSrc, std::vector<KeyLine>& keyline
 
 }
 
+/* runs LSD on a set of overlapping tiles of an image, one detector per tile */
+class LSDTileInvoker : public ParallelLoopBody
+{
+ public:
+  LSDTileInvoker( const Mat& _image, const std::vector<Rect>& _rois, const std::vector<Rect>& _cores, const LSDDetector::LSDOptions& _opts,
+                  std::vector<std::vector<Vec4f> >& _tileLines ) :
+      image( _image ),
+      rois( _rois ),
+      cores( _cores ),
+      opts( _opts ),
+      tileLines( _tileLines )
+  {
+  }
+
+  void operator()( const Range& range ) const
+  {
+    for ( int t = range.start; t < range.end; t++ )
+    {
+      cv::Ptr<cv::LineSegmentDetector> ls = cv::createLineSegmentDetector( opts.refine, opts.scale, opts.sigma_scale, opts.quant, opts.ang_th,
+                                                                           opts.log_eps, opts.density_th, opts.n_bins );
+      std::vector<Vec4f> lines;
+      ls->detect( image( rois[t] ), lines );
+
+      /* keep the segments whose middle point lies in the tile (the overlap belongs to the neighbours) */
+      for ( size_t k = 0; k < lines.size(); k++ )
+      {
+        Vec4f l = lines[k];
+        l[0] += rois[t].x;
+        l[1] += rois[t].y;
+        l[2] += rois[t].x;
+        l[3] += rois[t].y;
+        float mx = ( l[0] + l[2] ) / 2, my = ( l[1] + l[3] ) / 2;
+        if( mx >= cores[t].x && mx < cores[t].x + cores[t].width && my >= cores[t].y && my < cores[t].y + cores[t].height )
+          tileLines[t].push_back( l );
+      }
+    }
+  }
+
+ private:
+  const Mat& image;
+  const std::vector<Rect>& rois;
+  const std::vector<Rect>& cores;
+  const LSDDetector::LSDOptions& opts;
+  std::vector<std::vector<Vec4f> >& tileLines;
+};
+
+/* distance from a segment's extremes to the closest seam between tiles */
+static float seamDistance( const Vec4f& l, const std::vector<int>& seamsX, const std::vector<int>& seamsY )
+{
+  float dist = FLT_MAX;
+  for ( size_t i = 0; i < seamsX.size(); i++ )
+    dist = std::min( dist, std::min( std::abs( l[0] - seamsX[i] ), std::abs( l[2] - seamsX[i] ) ) );
+  for ( size_t i = 0; i < seamsY.size(); i++ )
+    dist = std::min( dist, std::min( std::abs( l[1] - seamsY[i] ), std::abs( l[3] - seamsY[i] ) ) );
+  return dist;
+}
+
+/* merge two pieces of the same segment if they are collinear, have the same polarity and their extremes are close */
+static bool mergeSegments( Vec4f& a, const Vec4f& b, float cosTh, float distTh )
+{
+  float dax = a[2] - a[0], day = a[3] - a[1];
+  float dbx = b[2] - b[0], dby = b[3] - b[1];
+  float la = std::sqrt( dax * dax + day * day ), lb = std::sqrt( dbx * dbx + dby * dby );
+  if( la < FLT_EPSILON || lb < FLT_EPSILON )
+    return false;
+
+  /* same direction (LSD segments are oriented by the gradient, so polarity must agree) */
+  float ux = dax / la, uy = day / la;
+  if( ( ux * dbx + uy * dby ) / lb < cosTh )
+    return false;
+
+  /* extremes of b close to the supporting line of a */
+  if( std::abs( -uy * ( b[0] - a[0] ) + ux * ( b[1] - a[1] ) ) > distTh || std::abs( -uy * ( b[2] - a[0] ) + ux * ( b[3] - a[1] ) ) > distTh )
+    return false;
+
+  /* overlapping or with a small gap along the line */
+  float tbs = ux * ( b[0] - a[0] ) + uy * ( b[1] - a[1] );
+  float tbe = ux * ( b[2] - a[0] ) + uy * ( b[3] - a[1] );
+  if( tbs > la + distTh || tbe < -distTh )
+    return false;
+
+  /* keep the farthest extremes */
+  if( tbs < 0 )
+  {
+    a[0] = b[0];
+    a[1] = b[1];
+  }
+  if( tbe > la )
+  {
+    a[2] = b[2];
+    a[3] = b[3];
+  }
+  return true;
+}
+
+void LSDDetector::detectTiled( const Mat& image, std::vector<Vec4f>& lines, const LSDOptions& opts ) const
+{
+  /* split the image in a grid of tiles, each one padded with the overlap */
+  int nCols = std::max( 1, opts.grid_cols ), nRows = std::max( 1, opts.grid_rows );
+  std::vector<Rect> rois, cores;
+  std::vector<int> seamsX, seamsY;
+  for ( int r = 0; r < nRows; r++ )
+  {
+    for ( int c = 0; c < nCols; c++ )
+    {
+      int x0 = c * image.cols / nCols, x1 = ( c + 1 ) * image.cols / nCols;
+      int y0 = r * image.rows / nRows, y1 = ( r + 1 ) * image.rows / nRows;
+      cores.push_back( Rect( x0, y0, x1 - x0, y1 - y0 ) );
+      rois.push_back( Rect( x0 - opts.tile_overlap, y0 - opts.tile_overlap, x1 - x0 + 2 * opts.tile_overlap, y1 - y0 + 2 * opts.tile_overlap )
+          & Rect( 0, 0, image.cols, image.rows ) );
+    }
+  }
+  for ( int c = 1; c < nCols; c++ )
+    seamsX.push_back( c * image.cols / nCols );
+  for ( int r = 1; r < nRows; r++ )
+    seamsY.push_back( r * image.rows / nRows );
+
+  /* detect in parallel */
+  std::vector<std::vector<Vec4f> > tileLines( rois.size() );
+  parallel_for_( Range( 0, (int) rois.size() ), LSDTileInvoker( image, rois, cores, opts, tileLines ) );
+
+  /* gather the segments (in tile order), setting apart the ones that may have been split by a seam */
+  std::vector<Vec4f> seamLines;
+  float seamTh = (float) ( opts.tile_overlap + opts.merge_dist_th );
+  for ( size_t t = 0; t < tileLines.size(); t++ )
+  {
+    for ( size_t k = 0; k < tileLines[t].size(); k++ )
+    {
+      if( seamDistance( tileLines[t][k], seamsX, seamsY ) <= seamTh )
+        seamLines.push_back( tileLines[t][k] );
+      else
+        lines.push_back( tileLines[t][k] );
+    }
+  }
+
+  /* merge the pieces of the segments that cross a seam */
+  float cosTh = (float) std::cos( opts.merge_ang_th * CV_PI / 180.0 );
+  for ( size_t i = 0; i < seamLines.size(); i++ )
+  {
+    for ( size_t j = i + 1; j < seamLines.size(); j++ )
+    {
+      if( mergeSegments( seamLines[i], seamLines[j], cosTh, (float) opts.merge_dist_th ) )
+      {
+        seamLines.erase( seamLines.begin() + j );
+        j = i;
+      }
+    }
+  }
+  lines.insert( lines.end(), seamLines.begin(), seamLines.end() );
+}
+
 // Overload detect and detectImpl with LSDDetector Options
 void LSDDetector::detect( const Mat& image, CV_OUT std::vector<KeyLine>& keylines, int scale, int numOctaves, LSDOptions opts, const Mat& mask )
 {
@@ -224,13 +375,25 @@ void LSDDetector::detect( const Mat& image, CV_OUT std::vector<KeyLine>& keyline
     detectImpl( image, keylines, numOctaves, scale, opts, mask );
 }
 
+void LSDDetector::detect( const std::vector<Mat>& pyramid, CV_OUT std::vector<KeyLine>& keylines, int scale, LSDOptions opts, const Mat& mask )
+{
+  if( pyramid.empty() || pyramid[0].channels() != 1 || pyramid[0].depth() != 0 )
+    throw std::runtime_error( "Error, the pyramid must contain at least one grayscale image of depth 0" );
+
+  if( mask.data != NULL && ( mask.size() != pyramid[0].size() || mask.type() != CV_8UC1 ) )
+    throw std::runtime_error( "Mask error while detecting lines: please check its dimensions and that data type is CV_8UC1" );
+
+  gaussianPyrs = pyramid;
+  detectPyramid( keylines, scale, opts, mask );
+}
+
 void LSDDetector::detectImpl( const Mat& imageSrc, std::vector<KeyLine>& keylines, int numOctaves, int scale, LSDOptions opts, const Mat& mask ) const
 {
   cv::Mat image;
   if( imageSrc.channels() != 1 )
     cvtColor( imageSrc, image, COLOR_BGR2GRAY );
   else
-    image = imageSrc.clone();
+    image = imageSrc;
 
   /*check whether image depth is different from 0 */
   if( image.depth() != 0 )
@@ -242,6 +405,13 @@ void LSDDetector::detectImpl( const Mat& imageSrc, std::vector<KeyLine>& keyline
   /* compute Gaussian pyramids */
   lsd->computeGaussianPyramid( image, numOctaves, scale );
 
+  detectPyramid( keylines, scale, opts, mask );
+}
+
+void LSDDetector::detectPyramid( std::vector<KeyLine>& keylines, int scale, const LSDOptions& opts, const Mat& mask ) const
+{
+  int numOctaves = (int) gaussianPyrs.size();
+
   /* create an LSD extractor */
   cv::Ptr<cv::LineSegmentDetector> ls = cv::createLineSegmentDetector( opts.refine,
                                                                        opts.scale,
@@ -255,11 +425,15 @@ void LSDDetector::detectImpl( const Mat& imageSrc, std::vector<KeyLine>& keyline
   /* prepare a vector to host extracted segments */
   std::vector<std::vector<cv::Vec4f> > lines_lsd;
 
-  /* extract lines */
+  /* extract lines (tile-parallel if requested) */
+  bool tiled = opts.grid_cols * opts.grid_rows > 1;
   for ( int i = 0; i < numOctaves; i++ )
   {
     std::vector<Vec4f> octave_lines;
-    ls->detect( gaussianPyrs[i], octave_lines );
+    if( tiled )
+      detectTiled( gaussianPyrs[i], octave_lines, opts );
+    else
+      ls->detect( gaussianPyrs[i], octave_lines );
     lines_lsd.push_back( octave_lines );
   }
 
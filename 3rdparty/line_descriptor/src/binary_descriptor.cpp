@@ -41,6 +41,16 @@
 
 #include "precomp.hpp"
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/* the vectorized LBD kernel matches the scalar one only if no multiply-add is contracted into an
+ FMA (CMakeLists.txt builds this file with -ffp-contract=off, clang also honours the pragma) */
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#endif
+
 #ifdef _MSC_VER
     #if (_MSC_VER <= 1700)
         /* This function rounds x to the nearest integer, but rounds halfway cases away from zero. */
@@ -186,6 +196,16 @@ void BinaryDescriptor::setReductionRatio( int rRatio )
   params.reductionRatio = rRatio;
 }
 
+int BinaryDescriptor::getMaxThreads() const
+{
+  return maxThreads_;
+}
+
+void BinaryDescriptor::setMaxThreads( int nthreads )
+{
+  maxThreads_ = nthreads;
+}
+
 /* read parameters from a FileNode object and store them (struct function) */
 void BinaryDescriptor::Params::read( const cv::FileNode& fn )
 {
@@ -215,7 +235,8 @@ Ptr<BinaryDescriptor> BinaryDescriptor::createBinaryDescriptor( Params parameter
 
 /* construct a BinaryDescrptor object and compute external private parameters */
 BinaryDescriptor::BinaryDescriptor( const BinaryDescriptor::Params &parameters ) :
-    params( parameters )
+    params( parameters ),
+    maxThreads_( 0 )
 {
   /* reserve enough space for EDLine objects and images in Gaussian pyramid */
   edLineVec_.resize( params.numOfOctave_ );
@@ -353,9 +374,9 @@ void BinaryDescriptor::computeGaussianPyramid( const Mat& image, const int numOc
   images_sizes.clear();
   octaveImages.clear();
 
-  /* insert input image into pyramid */
-  cv::Mat currentMat = image.clone();
-  cv::GaussianBlur( currentMat, currentMat, cv::Size( 5, 5 ), 1 );
+  /* insert input image into pyramid (blurred directly from the input) */
+  cv::Mat currentMat;
+  cv::GaussianBlur( image, currentMat, cv::Size( 5, 5 ), 1 );
   octaveImages.push_back( currentMat );
   images_sizes.push_back( currentMat.size() );
 
@@ -400,6 +421,14 @@ void BinaryDescriptor::computeSobel( const cv::Mat& image, const int numOctaves
 /* utility function for conversion of an LBD descriptor to its binary representation */
 unsigned char BinaryDescriptor::binaryConversion( float* f1, float* f2 )
 {
+#if defined(__AVX__)
+  /* bit i is set when f1[i] > f2[i] */
+  return (uchar) _mm256_movemask_ps( _mm256_cmp_ps( _mm256_loadu_ps( f1 ), _mm256_loadu_ps( f2 ), _CMP_GT_OQ ) );
+#elif defined(__SSE2__)
+  int lo = _mm_movemask_ps( _mm_cmpgt_ps( _mm_loadu_ps( f1 ), _mm_loadu_ps( f2 ) ) );
+  int hi = _mm_movemask_ps( _mm_cmpgt_ps( _mm_loadu_ps( f1 + 4 ), _mm_loadu_ps( f2 + 4 ) ) );
+  return (uchar) ( lo | ( hi << 4 ) );
+#else
   uchar result = 0;
   for ( int i = 0; i < 8; i++ )
   {
@@ -408,7 +437,7 @@ unsigned char BinaryDescriptor::binaryConversion( float* f1, float* f2 )
   }
 
   return result;
-
+#endif
 }
 
 /* requires line detection (only one image) */
@@ -535,6 +564,32 @@ void BinaryDescriptor::compute( const std::vector<Mat>& images, std::vector<std:
     computeImpl( images[i], keylines[i], descriptors[i], returnFloatDescr, false );
 }
 
+/* requires descriptors computation (precomputed pyramid and derivatives) */
+void BinaryDescriptor::compute( const std::vector<Mat>& octaves, const std::vector<Mat>& dx, const std::vector<Mat>& dy,
+                                CV_OUT CV_IN_OUT std::vector<KeyLine>& keylines, CV_OUT Mat& descriptors, bool returnFloatDescr ) const
+{
+  /* keypoints list can't be empty */
+  if( keylines.size() == 0 )
+  {
+    std::cout << "Error: keypoint list is empty" << std::endl;
+    return;
+  }
+
+  if( octaves.size() != dx.size() || octaves.size() != dy.size() )
+    throw std::runtime_error( "Error, the pyramid and its derivatives must have the same number of octaves" );
+
+  /* use the given octaves and derivatives in place of the ones computed by computeSobel */
+  BinaryDescriptor* bd = const_cast<BinaryDescriptor*>( this );
+  bd->octaveImages = octaves;
+  bd->dxImg_vector = dx;
+  bd->dyImg_vector = dy;
+  bd->images_sizes.clear();
+  for ( size_t i = 0; i < octaves.size(); i++ )
+    bd->images_sizes.push_back( octaves[i].size() );
+
+  computeDescriptors( keylines, descriptors, returnFloatDescr, false );
+}
+
 /* implementation of descriptors computation */
 void BinaryDescriptor::computeImpl( const Mat& imageSrc, std::vector<KeyLine>& keylines, Mat& descriptors, bool returnFloatDescr,
                                     bool useDetectionData ) const
@@ -546,7 +601,7 @@ void BinaryDescriptor::computeImpl( const Mat& imageSrc, std::vector<KeyLine>& k
   if( imageSrc.channels() != 1 )
     cvtColor( imageSrc, image, COLOR_BGR2GRAY );
   else
-    image = imageSrc.clone();
+    image = imageSrc;
 
   /*check whether image's depth is different from 0 */
   if( image.depth() != 0 )
@@ -561,14 +616,10 @@ void BinaryDescriptor::computeImpl( const Mat& imageSrc, std::vector<KeyLine>& k
 
   BinaryDescriptor* bd = const_cast<BinaryDescriptor*>( this );
 
-  /* get maximum class_id and octave*/
-  int numLines = 0;
+  /* get maximum octave */
   int octaveIndex = -1;
   for ( size_t l = 0; l < keylines.size(); l++ )
   {
-    if( keylines[l].class_id > numLines )
-      numLines = keylines[l].class_id;
-
     if( keylines[l].octave > octaveIndex )
       octaveIndex = keylines[l].octave;
   }
@@ -576,114 +627,74 @@ void BinaryDescriptor::computeImpl( const Mat& imageSrc, std::vector<KeyLine>& k
   if( !useDetectionData )
     bd->computeSobel( image, octaveIndex + 1 );
 
-  /* create a ScaleLines object */
-  OctaveSingleLine fictiousOSL;
-//  fictiousOSL.octaveCount = params.numOfOctave_ + 1;
-//  LinesVec lv( params.numOfOctave_, fictiousOSL );
-  fictiousOSL.octaveCount = octaveIndex + 1;
-  LinesVec lv( octaveIndex + 1, fictiousOSL );
-  ScaleLines sl( numLines + 1, lv );
-
-  /* create a map to record association between KeyLines and their position
-   in ScaleLines vector */
-  std::map<std::pair<int, int>, size_t> correspondences;
-
-  /* fill ScaleLines object */
-  for ( size_t slCounter = 0; slCounter < keylines.size(); slCounter++ )
-  {
-    /* get a KeyLine object and create a new line */
-    KeyLine kl = keylines[slCounter];
-    OctaveSingleLine osl;
-
-    /* insert data in newly created line */
-    osl.startPointX = kl.startPointX;
-    osl.startPointY = kl.startPointY;
-    osl.endPointX = kl.endPointX;
-    osl.endPointY = kl.endPointY;
-    osl.sPointInOctaveX = kl.sPointInOctaveX;
-    osl.sPointInOctaveY = kl.sPointInOctaveY;
-    osl.ePointInOctaveX = kl.ePointInOctaveX;
-    osl.ePointInOctaveY = kl.ePointInOctaveY;
-    osl.lineLength = kl.lineLength;
-    osl.numOfPixels = kl.numOfPixels;
-    osl.salience = kl.response;
-
-    osl.direction = kl.angle;
-    osl.octaveCount = kl.octave;
-
-    /* store new line */
-    sl[kl.class_id][kl.octave] = osl;
-
-    /* update map */
-    int id = kl.class_id;
-    int oct = kl.octave;
-    correspondences.insert( std::pair<std::pair<int, int>, size_t>( std::pair<int, int>( id, oct ), slCounter ) );
-  }
+  computeDescriptors( keylines, descriptors, returnFloatDescr, useDetectionData );
+}
 
-  /* delete useless OctaveSingleLines */
-  for ( size_t i = 0; i < sl.size(); i++ )
+/* computes the descriptors of a range of lines; lines are independent, each stripe
+ only needs its own scratch buffer */
+class LBDComputeInvoker : public ParallelLoopBody
+{
+ public:
+  LBDComputeInvoker( BinaryDescriptor* _bd, std::vector<KeyLine>& _keylines, Mat& _descriptors, bool _returnFloatDescr, bool _useDetectionData ) :
+      bd( _bd ),
+      keylines( &_keylines ),
+      descriptors( &_descriptors ),
+      returnFloatDescr( _returnFloatDescr ),
+      useDetectionData( _useDetectionData )
   {
-    for ( size_t j = 0; j < sl[i].size(); j++ )
-    {
-      //if( (int) ( sl[i][j] ).octaveCount > params.numOfOctave_ )
-      if( (int) ( sl[i][j] ).octaveCount > octaveIndex )
-        ( sl[i] ).erase( ( sl[i] ).begin() + j );
-    }
   }
 
-  /* compute LBD descriptors */
-  bd->computeLBD( sl, useDetectionData );
-
-  /* resize output matrix */
-  if( !returnFloatDescr )
-    descriptors = cv::Mat( (int) keylines.size(), 32, CV_8UC1 );
-
-  else
-    descriptors = cv::Mat( (int) keylines.size(), NUM_OF_BANDS * 8, CV_32FC1 );
-
-  /* fill output matrix with descriptors */
-  for ( int k = 0; k < (int) sl.size(); k++ )
+  void operator()( const Range& range ) const
   {
-    for ( int lineC = 0; lineC < (int) sl[k].size(); lineC++ )
+    float desVec[NUM_OF_BANDS * 8];
+    for ( int i = range.start; i < range.end; i++ )
     {
-      /* get original index of keypoint */
-      int lineOctave = ( sl[k][lineC] ).octaveCount;
-      int originalIndex = (int)correspondences.find( std::pair<int, int>( k, lineOctave ) )->second;
-
       if( !returnFloatDescr )
       {
-        /* get a pointer to correspondent row in output matrix */
-        uchar* pointerToRow = descriptors.ptr( originalIndex );
-
-        /* get LBD data */
-        float* desVec = &sl[k][lineC].descriptor.front();
+        bd->computeLineLBD( ( *keylines )[i], useDetectionData, desVec );
 
         /* fill current row with binary descriptor */
+        uchar* pointerToRow = descriptors->ptr( i );
         for ( int comb = 0; comb < 32; comb++ )
-        {
-          *pointerToRow = bd->binaryConversion( &desVec[8 * combinations[comb][0]], &desVec[8 * combinations[comb][1]] );
-          pointerToRow++;
-        }
+          pointerToRow[comb] = bd->binaryConversion( &desVec[8 * combinations[comb][0]], &desVec[8 * combinations[comb][1]] );
       }
 
       else
-      {
-        /* get a pointer to correspondent row in output matrix */
-        float* pointerToRow = descriptors.ptr<float>( originalIndex );
+        bd->computeLineLBD( ( *keylines )[i], useDetectionData, descriptors->ptr<float>( i ) );
+    }
+  }
 
-        /* get LBD data */
-        std::vector<float> desVec = sl[k][lineC].descriptor;
+ private:
+  BinaryDescriptor* bd;
+  std::vector<KeyLine>* keylines;
+  Mat* descriptors;
+  bool returnFloatDescr;
+  bool useDetectionData;
+};
 
-        for ( int count = 0; count < (int) desVec.size(); count++ )
-        {
-          *pointerToRow = desVec[count];
-          pointerToRow++;
-        }
-      }
+/* computation of the descriptors from the current octaves and derivatives */
+void BinaryDescriptor::computeDescriptors( std::vector<KeyLine>& keylines, Mat& descriptors, bool returnFloatDescr, bool useDetectionData ) const
+{
+  BinaryDescriptor* bd = const_cast<BinaryDescriptor*>( this );
 
-    }
-  }
+  /* resize output matrix */
+  if( !returnFloatDescr )
+    descriptors = cv::Mat( (int) keylines.size(), 32, CV_8UC1 );
 
+  else
+    descriptors = cv::Mat( (int) keylines.size(), NUM_OF_BANDS * 8, CV_32FC1 );
+
+  /* compute the LBD descriptor of each line straight into its row; line lengths vary a lot,
+   so the lines are split in several stripes per thread to balance the load, unless the caller
+   limited the threads (the stripes are then as many as the threads, so that no more are used) */
+  LBDComputeInvoker invoker( bd, keylines, descriptors, returnFloatDescr, useDetectionData );
+  Range lines( 0, (int) keylines.size() );
+  if( maxThreads_ < 1 )
+    parallel_for_( lines, invoker, 4 * getNumThreads() );
+  else if( maxThreads_ == 1 )
+    invoker( lines );
+  else
+    parallel_for_( lines, invoker, std::min( maxThreads_, getNumThreads() ) );
 }
 
 int BinaryDescriptor::OctaveKeyLines( cv::Mat& image, ScaleLines &keyLines )
@@ -1024,11 +1035,64 @@ int BinaryDescriptor::OctaveKeyLines( cv::Mat& image, ScaleLines &keyLines )
 }
 
 int BinaryDescriptor::computeLBD( ScaleLines &keyLines, bool useDetectionData )
+{
+  short descriptor_size = NUM_OF_BANDS * 8;
+  KeyLine kl;
+
+  /* loop over list of LineVec */
+  for ( size_t lineIDInScaleVec = 0; lineIDInScaleVec < keyLines.size(); lineIDInScaleVec++ )
+  {
+    /* loop over current LineVec's lines */
+    for ( size_t lineIDInSameLine = 0; lineIDInSameLine < keyLines[lineIDInScaleVec].size(); lineIDInSameLine++ )
+    {
+      OctaveSingleLine& osl = keyLines[lineIDInScaleVec][lineIDInSameLine];
+      kl.sPointInOctaveX = osl.sPointInOctaveX;
+      kl.sPointInOctaveY = osl.sPointInOctaveY;
+      kl.ePointInOctaveX = osl.ePointInOctaveX;
+      kl.ePointInOctaveY = osl.ePointInOctaveY;
+      kl.angle = osl.direction;
+      kl.numOfPixels = (int) osl.numOfPixels;
+      kl.octave = (int) osl.octaveCount;
+
+      osl.descriptor.resize( descriptor_size );
+      computeLineLBD( kl, useDetectionData, &osl.descriptor.front() );
+    }
+  }
+
+  return 1;
+}
+
+#if defined(__AVX2__)
+/* rounds halfway cases away from zero, as round() */
+static inline __m256 roundHalfAway( __m256 x )
+{
+  const __m256 signMask = _mm256_set1_ps( -0.0f );
+  __m256 t = _mm256_round_ps( x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC );
+  /* x - t is exact, so is the comparison with one half */
+  __m256 f = _mm256_andnot_ps( signMask, _mm256_sub_ps( x, t ) );
+  __m256 one = _mm256_or_ps( _mm256_and_ps( x, signMask ), _mm256_set1_ps( 1.0f ) );
+  return _mm256_add_ps( t, _mm256_and_ps( _mm256_cmp_ps( f, _mm256_set1_ps( 0.5f ), _CMP_GE_OQ ), one ) );
+}
+
+/* gathers the shorts img[idx] of 8 lanes (sign extended); 32 bit gathers read img[idx] and img[idx + 1],
+ so the last pixel is read as the high half of its predecessor */
+static inline __m256i gatherShort( const short* img, __m256i idx, __m256i lastIdx )
+{
+  __m256i isLast = _mm256_cmpeq_epi32( idx, lastIdx );
+  __m256i safeIdx = _mm256_add_epi32( idx, isLast );
+  __m256i v = _mm256_i32gather_epi32( (const int* ) img, safeIdx, 2 );
+  __m256i lo = _mm256_srai_epi32( _mm256_slli_epi32( v, 16 ), 16 );
+  __m256i hi = _mm256_srai_epi32( v, 16 );
+  return _mm256_blendv_epi8( lo, hi, isLast );
+}
+#endif
+
+/* compute the LBD descriptor (NUM_OF_BANDS * 8 floats) of a single line */
+void BinaryDescriptor::computeLineLBD( const KeyLine& kl, bool useDetectionData, float* desVec ) const
 {
   //the default length of the band is the line length.
-  short numOfFinalLine = (short) keyLines.size();
-  float *dL = new float[2];  //line direction cos(dir), sin(dir)
-  float *dO = new float[2];  //the clockwise orthogonal vector of line direction.
+  float dL[2];  //line direction cos(dir), sin(dir)
+  float dO[2];  //the clockwise orthogonal vector of line direction.
   short heightOfLSP = (short) ( params.widthOfBand_ * NUM_OF_BANDS );  //the height of line support region;
   short descriptor_size = NUM_OF_BANDS * 8;  //each band, we compute the m( pgdL, ngdL,  pgdO, ngdO) and std( pgdL, ngdL,  pgdO, ngdO);
   float pgdLRowSum;  //the summation of {g_dL |g_dL>0 } for each row of the region;
@@ -1040,335 +1104,332 @@ int BinaryDescriptor::computeLBD( ScaleLines &keyLines, bool useDetectionData )
   float pgdO2RowSum;  //the summation of {g_dO^2 |g_dO>0 } for each row of the region;
   float ngdO2RowSum;  //the summation of {g_dO^2 |g_dO<0 } for each row of the region;
 
-  float *pgdLBandSum = new float[NUM_OF_BANDS];  //the summation of {g_dL |g_dL>0 } for each band of the region;
-  float *ngdLBandSum = new float[NUM_OF_BANDS];  //the summation of {g_dL |g_dL<0 } for each band of the region;
-  float *pgdL2BandSum = new float[NUM_OF_BANDS];  //the summation of {g_dL^2 |g_dL>0 } for each band of the region;
-  float *ngdL2BandSum = new float[NUM_OF_BANDS];  //the summation of {g_dL^2 |g_dL<0 } for each band of the region;
-  float *pgdOBandSum = new float[NUM_OF_BANDS];  //the summation of {g_dO |g_dO>0 } for each band of the region;
-  float *ngdOBandSum = new float[NUM_OF_BANDS];  //the summation of {g_dO |g_dO<0 } for each band of the region;
-  float *pgdO2BandSum = new float[NUM_OF_BANDS];  //the summation of {g_dO^2 |g_dO>0 } for each band of the region;
-  float *ngdO2BandSum = new float[NUM_OF_BANDS];  //the summation of {g_dO^2 |g_dO<0 } for each band of the region;
+  float pgdLBandSum[NUM_OF_BANDS] = { 0 };  //the summation of {g_dL |g_dL>0 } for each band of the region;
+  float ngdLBandSum[NUM_OF_BANDS] = { 0 };  //the summation of {g_dL |g_dL<0 } for each band of the region;
+  float pgdL2BandSum[NUM_OF_BANDS] = { 0 };  //the summation of {g_dL^2 |g_dL>0 } for each band of the region;
+  float ngdL2BandSum[NUM_OF_BANDS] = { 0 };  //the summation of {g_dL^2 |g_dL<0 } for each band of the region;
+  float pgdOBandSum[NUM_OF_BANDS] = { 0 };  //the summation of {g_dO |g_dO>0 } for each band of the region;
+  float ngdOBandSum[NUM_OF_BANDS] = { 0 };  //the summation of {g_dO |g_dO<0 } for each band of the region;
+  float pgdO2BandSum[NUM_OF_BANDS] = { 0 };  //the summation of {g_dO^2 |g_dO>0 } for each band of the region;
+  float ngdO2BandSum[NUM_OF_BANDS] = { 0 };  //the summation of {g_dO^2 |g_dO<0 } for each band of the region;
 
-  short numOfBitsBand = NUM_OF_BANDS * sizeof(float);
   short lengthOfLSP;  //the length of line support region, varies with lines
   short halfHeight = ( heightOfLSP - 1 ) / 2;
   short halfWidth;
   short bandID;
   float coefInGaussion;
   float lineMiddlePointX, lineMiddlePointY;
-  float sCorX, sCorY, sCorX0, sCorY0;
-  short tempCor, xCor, yCor;  //pixel coordinates in image plane
-  short dx, dy;
-  float gDL;  //store the gradient projection of pixels in support region along dL vector
-  float gDO;  //store the gradient projection of pixels in support region along dO vector
+  float sCorX0, sCorY0;
   short imageWidth, imageHeight, realWidth;
-  short *pdxImg, *pdyImg;
-  float *desVec;
+  const short *pdxImg, *pdyImg;
 
-  short sameLineSize;
-  short octaveCount;
-  OctaveSingleLine *pSingleLine;
-  /* loop over list of LineVec */
-  for ( short lineIDInScaleVec = 0; lineIDInScaleVec < numOfFinalLine; lineIDInScaleVec++ )
+  short octaveCount = (short) kl.octave;
+  if( useDetectionData )
   {
-    sameLineSize = (short) ( keyLines[lineIDInScaleVec].size() );
-    /* loop over current LineVec's lines */
-    for ( short lineIDInSameLine = 0; lineIDInSameLine < sameLineSize; lineIDInSameLine++ )
-    {
-      /* get a line in current LineVec and its original ID in its octave */
-      pSingleLine = & ( keyLines[lineIDInScaleVec][lineIDInSameLine] );
-      octaveCount = (short) pSingleLine->octaveCount;
+    /* retrieve associated dxImg and dyImg */
+    pdxImg = edLineVec_[octaveCount]->dxImg_.ptr<short>();
+    pdyImg = edLineVec_[octaveCount]->dyImg_.ptr<short>();
+
+    /* get image size to work on from real one */
+    realWidth = (short) edLineVec_[octaveCount]->imageWidth;
+    imageWidth = realWidth - 1;
+    imageHeight = (short) ( edLineVec_[octaveCount]->imageHeight - 1 );
+  }
 
-      if( useDetectionData )
-      {
-        /* retrieve associated dxImg and dyImg */
-        pdxImg = edLineVec_[octaveCount]->dxImg_.ptr<short>();
-        pdyImg = edLineVec_[octaveCount]->dyImg_.ptr<short>();
-
-        /* get image size to work on from real one */
-        realWidth = (short) edLineVec_[octaveCount]->imageWidth;
-        imageWidth = realWidth - 1;
-        imageHeight = (short) ( edLineVec_[octaveCount]->imageHeight - 1 );
-      }
+  else
+  {
+    /* retrieve associated dxImg and dyImg */
+    pdxImg = dxImg_vector[octaveCount].ptr<short>();
+    pdyImg = dyImg_vector[octaveCount].ptr<short>();
+
+    /* get image size to work on from real one */
+    realWidth = (short) images_sizes[octaveCount].width;
+    imageWidth = realWidth - 1;
+    imageHeight = (short) ( images_sizes[octaveCount].height - 1 );
+  }
 
-      else
-      {
-        /* retrieve associated dxImg and dyImg */
-        pdxImg = dxImg_vector[octaveCount].ptr<short>();
-        pdyImg = dyImg_vector[octaveCount].ptr<short>();
-
-        /* get image size to work on from real one */
-        realWidth = (short) images_sizes[octaveCount].width;
-        imageWidth = realWidth - 1;
-        imageHeight = (short) ( images_sizes[octaveCount].height - 1 );
-      }
+  /* get length of line and its half */
+  lengthOfLSP = (short) kl.numOfPixels;
+  halfWidth = ( lengthOfLSP - 1 ) / 2;
+
+  /* get middlepoint of line */
+  lineMiddlePointX = (float) ( 0.5 * ( kl.sPointInOctaveX + kl.ePointInOctaveX ) );
+  lineMiddlePointY = (float) ( 0.5 * ( kl.sPointInOctaveY + kl.ePointInOctaveY ) );
+
+  /*1.rotate the local coordinate system to the line direction (direction is the angle
+   between positive line direction and positive X axis)
+   *2.compute the gradient projection of pixels in line support region*/
+
+  /* get the vector representing original image reference system after rotation to aligh with
+   line's direction */
+  dL[0] = cos( kl.angle );
+  dL[1] = sin( kl.angle );
+
+  /* set the clockwise orthogonal vector of line direction */
+  dO[0] = -dL[1];
+  dO[1] = dL[0];
+
+  /* get rotated reference frame */
+  sCorX0 = -dL[0] * halfWidth + dL[1] * halfHeight + lineMiddlePointX;  //hID =0; wID = 0;
+  sCorY0 = -dL[1] * halfWidth - dL[0] * halfHeight + lineMiddlePointY;
+
+  /* flat buffer with the start of each row of the region and its four gradient sums; the rows
+   are padded to a multiple of 8, the padding rows are clamped to the image and discarded */
+  int paddedHeight = ( heightOfLSP + 7 ) & ~7;
+  cv::AutoBuffer<float> buffer( 6 * paddedHeight );
+  float* rowX0 = buffer;
+  float* rowY0 = rowX0 + paddedHeight;
+  float* pgdLRow = rowY0 + paddedHeight;
+  float* ngdLRow = pgdLRow + paddedHeight;
+  float* pgdORow = ngdLRow + paddedHeight;
+  float* ngdORow = pgdORow + paddedHeight;
+  for ( int hID = 0; hID < paddedHeight; hID++ )
+  {
+    rowX0[hID] = sCorX0;
+    rowY0[hID] = sCorY0;
+    sCorX0 -= dL[1];
+    sCorY0 += dL[0];
+  }
 
-      /* initialize memory areas */
-      memset( pgdLBandSum, 0, numOfBitsBand );
-      memset( ngdLBandSum, 0, numOfBitsBand );
-      memset( pgdL2BandSum, 0, numOfBitsBand );
-      memset( ngdL2BandSum, 0, numOfBitsBand );
-      memset( pgdOBandSum, 0, numOfBitsBand );
-      memset( ngdOBandSum, 0, numOfBitsBand );
-      memset( pgdO2BandSum, 0, numOfBitsBand );
-      memset( ngdO2BandSum, 0, numOfBitsBand );
-
-      /* get length of line and its half */
-      lengthOfLSP = (short) keyLines[lineIDInScaleVec][lineIDInSameLine].numOfPixels;
-      halfWidth = ( lengthOfLSP - 1 ) / 2;
-
-      /* get middlepoint of line */
-      lineMiddlePointX = (float) ( 0.5 * ( pSingleLine->sPointInOctaveX + pSingleLine->ePointInOctaveX ) );
-      lineMiddlePointY = (float) ( 0.5 * ( pSingleLine->sPointInOctaveY + pSingleLine->ePointInOctaveY ) );
-
-      /*1.rotate the local coordinate system to the line direction (direction is the angle
-       between positive line direction and positive X axis)
-       *2.compute the gradient projection of pixels in line support region*/
-
-      /* get the vector representing original image reference system after rotation to aligh with
-       line's direction */
-      dL[0] = cos( pSingleLine->direction );
-      dL[1] = sin( pSingleLine->direction );
-
-      /* set the clockwise orthogonal vector of line direction */
-      dO[0] = -dL[1];
-      dO[1] = dL[0];
-
-      /* get rotated reference frame */
-      sCorX0 = -dL[0] * halfWidth + dL[1] * halfHeight + lineMiddlePointX;  //hID =0; wID = 0;
-      sCorY0 = -dL[1] * halfWidth - dL[0] * halfHeight + lineMiddlePointY;
-
-      /* BIAS::Matrix<float> gDLMat(heightOfLSP,lengthOfLSP) */
-      for ( short hID = 0; hID < heightOfLSP; hID++ )
+  int hStart = 0;
+#if defined(__AVX2__)
+  /* each lane walks one row of the region, in the same order as the scalar loop; cv::setUseOptimized( false )
+   falls back to the scalar loop, the two give bit-exact descriptors */
+  int lastPixel = realWidth * ( imageHeight + 1 ) - 1;
+  if( lastPixel > 0 && cv::useOptimized() )
+  {
+    const __m256 vdL0 = _mm256_set1_ps( dL[0] ), vdL1 = _mm256_set1_ps( dL[1] );
+    const __m256 vdO0 = _mm256_set1_ps( dO[0] ), vdO1 = _mm256_set1_ps( dO[1] );
+    const __m256 vzero = _mm256_setzero_ps();
+    const __m256i vzeroi = _mm256_setzero_si256();
+    const __m256i vImageWidth = _mm256_set1_epi32( imageWidth ), vImageHeight = _mm256_set1_epi32( imageHeight );
+    const __m256i vRealWidth = _mm256_set1_epi32( realWidth ), vLastPixel = _mm256_set1_epi32( lastPixel );
+    for ( ; hStart < heightOfLSP; hStart += 8 )
+    {
+      __m256 sCorX = _mm256_loadu_ps( rowX0 + hStart );
+      __m256 sCorY = _mm256_loadu_ps( rowY0 + hStart );
+      __m256 pgdL = vzero, ngdL = vzero, pgdO = vzero, ngdO = vzero;
+      for ( short wID = 0; wID < lengthOfLSP; wID++ )
       {
-        /*initialization */
-        sCorX = sCorX0;
-        sCorY = sCorY0;
-
-        pgdLRowSum = 0;
-        ngdLRowSum = 0;
-        pgdORowSum = 0;
-        ngdORowSum = 0;
-
-        for ( short wID = 0; wID < lengthOfLSP; wID++ )
-        {
-          tempCor = (short) round( sCorX );
-          xCor = ( tempCor < 0 ) ? 0 : ( tempCor > imageWidth ) ? imageWidth : tempCor;
-          tempCor = (short) round( sCorY );
-          yCor = ( tempCor < 0 ) ? 0 : ( tempCor > imageHeight ) ? imageHeight : tempCor;
-
-          /* To achieve rotation invariance, each simple gradient is rotated aligned with
-           * the line direction and clockwise orthogonal direction.*/
-          dx = pdxImg[yCor * realWidth + xCor];
-          dy = pdyImg[yCor * realWidth + xCor];
-          gDL = dx * dL[0] + dy * dL[1];
-          gDO = dx * dO[0] + dy * dO[1];
-          if( gDL > 0 )
-          {
-            pgdLRowSum += gDL;
-          }
-          else
-          {
-            ngdLRowSum -= gDL;
-          }
-          if( gDO > 0 )
-          {
-            pgdORowSum += gDO;
-          }
-          else
-          {
-            ngdORowSum -= gDO;
-          }
-          sCorX += dL[0];
-          sCorY += dL[1];
-          /* gDLMat[hID][wID] = gDL; */
-        }
-        sCorX0 -= dL[1];
-        sCorY0 += dL[0];
-        coefInGaussion = (float) gaussCoefG_[hID];
-        pgdLRowSum = coefInGaussion * pgdLRowSum;
-        ngdLRowSum = coefInGaussion * ngdLRowSum;
-        pgdL2RowSum = pgdLRowSum * pgdLRowSum;
-        ngdL2RowSum = ngdLRowSum * ngdLRowSum;
-        pgdORowSum = coefInGaussion * pgdORowSum;
-        ngdORowSum = coefInGaussion * ngdORowSum;
-        pgdO2RowSum = pgdORowSum * pgdORowSum;
-        ngdO2RowSum = ngdORowSum * ngdORowSum;
-
-        /* compute {g_dL |g_dL>0 }, {g_dL |g_dL<0 },
-         {g_dO |g_dO>0 }, {g_dO |g_dO<0 } of each band in the line support region
-         first, current row belong to current band */
-        bandID = (short) ( hID / params.widthOfBand_ );
-        coefInGaussion = (float) ( gaussCoefL_[hID % params.widthOfBand_ + params.widthOfBand_] );
-        pgdLBandSum[bandID] += coefInGaussion * pgdLRowSum;
-        ngdLBandSum[bandID] += coefInGaussion * ngdLRowSum;
-        pgdL2BandSum[bandID] += coefInGaussion * coefInGaussion * pgdL2RowSum;
-        ngdL2BandSum[bandID] += coefInGaussion * coefInGaussion * ngdL2RowSum;
-        pgdOBandSum[bandID] += coefInGaussion * pgdORowSum;
-        ngdOBandSum[bandID] += coefInGaussion * ngdORowSum;
-        pgdO2BandSum[bandID] += coefInGaussion * coefInGaussion * pgdO2RowSum;
-        ngdO2BandSum[bandID] += coefInGaussion * coefInGaussion * ngdO2RowSum;
-
-        /* In order to reduce boundary effect along the line gradient direction,
-         * a row's gradient will contribute not only to its current band, but also
-         * to its nearest upper and down band with gaussCoefL_.*/
-        bandID--;
-        if( bandID >= 0 )
-        {/* the band above the current band */
-          coefInGaussion = (float) ( gaussCoefL_[hID % params.widthOfBand_ + 2 * params.widthOfBand_] );
-          pgdLBandSum[bandID] += coefInGaussion * pgdLRowSum;
-          ngdLBandSum[bandID] += coefInGaussion * ngdLRowSum;
-          pgdL2BandSum[bandID] += coefInGaussion * coefInGaussion * pgdL2RowSum;
-          ngdL2BandSum[bandID] += coefInGaussion * coefInGaussion * ngdL2RowSum;
-          pgdOBandSum[bandID] += coefInGaussion * pgdORowSum;
-          ngdOBandSum[bandID] += coefInGaussion * ngdORowSum;
-          pgdO2BandSum[bandID] += coefInGaussion * coefInGaussion * pgdO2RowSum;
-          ngdO2BandSum[bandID] += coefInGaussion * coefInGaussion * ngdO2RowSum;
-        }
-        bandID = bandID + 2;
-        if( bandID < NUM_OF_BANDS )
-        {/*the band below the current band */
-          coefInGaussion = (float) ( gaussCoefL_[hID % params.widthOfBand_] );
-          pgdLBandSum[bandID] += coefInGaussion * pgdLRowSum;
-          ngdLBandSum[bandID] += coefInGaussion * ngdLRowSum;
-          pgdL2BandSum[bandID] += coefInGaussion * coefInGaussion * pgdL2RowSum;
-          ngdL2BandSum[bandID] += coefInGaussion * coefInGaussion * ngdL2RowSum;
-          pgdOBandSum[bandID] += coefInGaussion * pgdORowSum;
-          ngdOBandSum[bandID] += coefInGaussion * ngdORowSum;
-          pgdO2BandSum[bandID] += coefInGaussion * coefInGaussion * pgdO2RowSum;
-          ngdO2BandSum[bandID] += coefInGaussion * coefInGaussion * ngdO2RowSum;
-        }
+        __m256i xCor = _mm256_cvttps_epi32( roundHalfAway( sCorX ) );
+        xCor = _mm256_min_epi32( _mm256_max_epi32( xCor, vzeroi ), vImageWidth );
+        __m256i yCor = _mm256_cvttps_epi32( roundHalfAway( sCorY ) );
+        yCor = _mm256_min_epi32( _mm256_max_epi32( yCor, vzeroi ), vImageHeight );
+        __m256i idx = _mm256_add_epi32( _mm256_mullo_epi32( yCor, vRealWidth ), xCor );
+
+        __m256 dx = _mm256_cvtepi32_ps( gatherShort( pdxImg, idx, vLastPixel ) );
+        __m256 dy = _mm256_cvtepi32_ps( gatherShort( pdyImg, idx, vLastPixel ) );
+        /* the products are never fused: this file is built with -ffp-contract=off, so that the
+         scalar dx * dL[0] + dy * dL[1] rounds each product as well */
+        __m256 gDL = _mm256_add_ps( _mm256_mul_ps( dx, vdL0 ), _mm256_mul_ps( dy, vdL1 ) );
+        __m256 gDO = _mm256_add_ps( _mm256_mul_ps( dx, vdO0 ), _mm256_mul_ps( dy, vdO1 ) );
+
+        /* adding zero leaves the other sum unchanged */
+        __m256 posL = _mm256_cmp_ps( gDL, vzero, _CMP_GT_OQ );
+        pgdL = _mm256_add_ps( pgdL, _mm256_and_ps( posL, gDL ) );
+        ngdL = _mm256_sub_ps( ngdL, _mm256_andnot_ps( posL, gDL ) );
+        __m256 posO = _mm256_cmp_ps( gDO, vzero, _CMP_GT_OQ );
+        pgdO = _mm256_add_ps( pgdO, _mm256_and_ps( posO, gDO ) );
+        ngdO = _mm256_sub_ps( ngdO, _mm256_andnot_ps( posO, gDO ) );
+
+        sCorX = _mm256_add_ps( sCorX, vdL0 );
+        sCorY = _mm256_add_ps( sCorY, vdL1 );
       }
-      /* gDLMat.Save("gDLMat.txt");
-       return 0; */
-
-      /* construct line descriptor */
-      pSingleLine->descriptor.resize( descriptor_size );
-      desVec = &pSingleLine->descriptor.front();
-
-      short desID;
+      _mm256_storeu_ps( pgdLRow + hStart, pgdL );
+      _mm256_storeu_ps( ngdLRow + hStart, ngdL );
+      _mm256_storeu_ps( pgdORow + hStart, pgdO );
+      _mm256_storeu_ps( ngdORow + hStart, ngdO );
+    }
+  }
+#endif
 
-      /*Note that the first and last bands only have (lengthOfLSP * widthOfBand_ * 2.0) pixels
-       * which are counted. */
-      float invN2 = (float) ( 1.0 / ( params.widthOfBand_ * 2.0 ) );
-      float invN3 = (float) ( 1.0 / ( params.widthOfBand_ * 3.0 ) );
-      float invN, temp;
-      for ( bandID = 0; bandID < NUM_OF_BANDS; bandID++ )
-      {
-        if( bandID == 0 || bandID == NUM_OF_BANDS - 1 )
-        {
-          invN = invN2;
-        }
-        else
-        {
-          invN = invN3;
-        }
-        desID = bandID * 8;
-        temp = pgdLBandSum[bandID] * invN;
-        desVec[desID] = temp;/* mean value of pgdL; */
-        desVec[desID + 4] = sqrt( pgdL2BandSum[bandID] * invN - temp * temp );  //std value of pgdL;
-        temp = ngdLBandSum[bandID] * invN;
-        desVec[desID + 1] = temp;  //mean value of ngdL;
-        desVec[desID + 5] = sqrt( ngdL2BandSum[bandID] * invN - temp * temp );  //std value of ngdL;
-
-        temp = pgdOBandSum[bandID] * invN;
-        desVec[desID + 2] = temp;  //mean value of pgdO;
-        desVec[desID + 6] = sqrt( pgdO2BandSum[bandID] * invN - temp * temp );  //std value of pgdO;
-        temp = ngdOBandSum[bandID] * invN;
-        desVec[desID + 3] = temp;  //mean value of ngdO;
-        desVec[desID + 7] = sqrt( ngdO2BandSum[bandID] * invN - temp * temp );  //std value of ngdO;
-      }
+  for ( short hID = (short) hStart; hID < heightOfLSP; hID++ )
+  {
+    float sCorX = rowX0[hID];
+    float sCorY = rowY0[hID];
+    pgdLRowSum = 0;
+    ngdLRowSum = 0;
+    pgdORowSum = 0;
+    ngdORowSum = 0;
+
+    for ( short wID = 0; wID < lengthOfLSP; wID++ )
+    {
+      short tempCor = (short) round( sCorX );
+      short xCor = ( tempCor < 0 ) ? 0 : ( tempCor > imageWidth ) ? imageWidth : tempCor;
+      tempCor = (short) round( sCorY );
+      short yCor = ( tempCor < 0 ) ? 0 : ( tempCor > imageHeight ) ? imageHeight : tempCor;
+
+      /* To achieve rotation invariance, each simple gradient is rotated aligned with
+       * the line direction and clockwise orthogonal direction.*/
+      short dx = pdxImg[yCor * realWidth + xCor];
+      short dy = pdyImg[yCor * realWidth + xCor];
+      float gDL = dx * dL[0] + dy * dL[1];
+      float gDO = dx * dO[0] + dy * dO[1];
+      if( gDL > 0 )
+        pgdLRowSum += gDL;
+      else
+        ngdLRowSum -= gDL;
+      if( gDO > 0 )
+        pgdORowSum += gDO;
+      else
+        ngdORowSum -= gDO;
+      sCorX += dL[0];
+      sCorY += dL[1];
+    }
+    pgdLRow[hID] = pgdLRowSum;
+    ngdLRow[hID] = ngdLRowSum;
+    pgdORow[hID] = pgdORowSum;
+    ngdORow[hID] = ngdORowSum;
+  }
 
-      // normalize;
-      float tempM, tempS;
-      tempM = 0;
-      tempS = 0;
-      desVec = &pSingleLine->descriptor.front();
+  for ( short hID = 0; hID < heightOfLSP; hID++ )
+  {
+    coefInGaussion = (float) gaussCoefG_[hID];
+    pgdLRowSum = coefInGaussion * pgdLRow[hID];
+    ngdLRowSum = coefInGaussion * ngdLRow[hID];
+    pgdL2RowSum = pgdLRowSum * pgdLRowSum;
+    ngdL2RowSum = ngdLRowSum * ngdLRowSum;
+    pgdORowSum = coefInGaussion * pgdORow[hID];
+    ngdORowSum = coefInGaussion * ngdORow[hID];
+    pgdO2RowSum = pgdORowSum * pgdORowSum;
+    ngdO2RowSum = ngdORowSum * ngdORowSum;
+
+    /* compute {g_dL |g_dL>0 }, {g_dL |g_dL<0 },
+     {g_dO |g_dO>0 }, {g_dO |g_dO<0 } of each band in the line support region
+     first, current row belong to current band */
+    bandID = (short) ( hID / params.widthOfBand_ );
+    coefInGaussion = (float) ( gaussCoefL_[hID % params.widthOfBand_ + params.widthOfBand_] );
+    pgdLBandSum[bandID] += coefInGaussion * pgdLRowSum;
+    ngdLBandSum[bandID] += coefInGaussion * ngdLRowSum;
+    pgdL2BandSum[bandID] += coefInGaussion * coefInGaussion * pgdL2RowSum;
+    ngdL2BandSum[bandID] += coefInGaussion * coefInGaussion * ngdL2RowSum;
+    pgdOBandSum[bandID] += coefInGaussion * pgdORowSum;
+    ngdOBandSum[bandID] += coefInGaussion * ngdORowSum;
+    pgdO2BandSum[bandID] += coefInGaussion * coefInGaussion * pgdO2RowSum;
+    ngdO2BandSum[bandID] += coefInGaussion * coefInGaussion * ngdO2RowSum;
+
+    /* In order to reduce boundary effect along the line gradient direction,
+     * a row's gradient will contribute not only to its current band, but also
+     * to its nearest upper and down band with gaussCoefL_.*/
+    bandID--;
+    if( bandID >= 0 )
+    {/* the band above the current band */
+      coefInGaussion = (float) ( gaussCoefL_[hID % params.widthOfBand_ + 2 * params.widthOfBand_] );
+      pgdLBandSum[bandID] += coefInGaussion * pgdLRowSum;
+      ngdLBandSum[bandID] += coefInGaussion * ngdLRowSum;
+      pgdL2BandSum[bandID] += coefInGaussion * coefInGaussion * pgdL2RowSum;
+      ngdL2BandSum[bandID] += coefInGaussion * coefInGaussion * ngdL2RowSum;
+      pgdOBandSum[bandID] += coefInGaussion * pgdORowSum;
+      ngdOBandSum[bandID] += coefInGaussion * ngdORowSum;
+      pgdO2BandSum[bandID] += coefInGaussion * coefInGaussion * pgdO2RowSum;
+      ngdO2BandSum[bandID] += coefInGaussion * coefInGaussion * ngdO2RowSum;
+    }
+    bandID = bandID + 2;
+    if( bandID < NUM_OF_BANDS )
+    {/*the band below the current band */
+      coefInGaussion = (float) ( gaussCoefL_[hID % params.widthOfBand_] );
+      pgdLBandSum[bandID] += coefInGaussion * pgdLRowSum;
+      ngdLBandSum[bandID] += coefInGaussion * ngdLRowSum;
+      pgdL2BandSum[bandID] += coefInGaussion * coefInGaussion * pgdL2RowSum;
+      ngdL2BandSum[bandID] += coefInGaussion * coefInGaussion * ngdL2RowSum;
+      pgdOBandSum[bandID] += coefInGaussion * pgdORowSum;
+      ngdOBandSum[bandID] += coefInGaussion * ngdORowSum;
+      pgdO2BandSum[bandID] += coefInGaussion * coefInGaussion * pgdO2RowSum;
+      ngdO2BandSum[bandID] += coefInGaussion * coefInGaussion * ngdO2RowSum;
+    }
+  }
 
-      int base = 0;
-      for ( short i = 0; i < (short) ( NUM_OF_BANDS * 8 ); ++base, i = (short) ( base * 8 ) )
-      {
-        tempM += * ( desVec + i ) * * ( desVec + i );  //desVec[8*i+0] * desVec[8*i+0];
-        tempM += * ( desVec + i + 1 ) * * ( desVec + i + 1 );  //desVec[8*i+1] * desVec[8*i+1];
-        tempM += * ( desVec + i + 2 ) * * ( desVec + i + 2 );  //desVec[8*i+2] * desVec[8*i+2];
-        tempM += * ( desVec + i + 3 ) * * ( desVec + i + 3 );  //desVec[8*i+3] * desVec[8*i+3];
-        tempS += * ( desVec + i + 4 ) * * ( desVec + i + 4 );  //desVec[8*i+4] * desVec[8*i+4];
-        tempS += * ( desVec + i + 5 ) * * ( desVec + i + 5 );  //desVec[8*i+5] * desVec[8*i+5];
-        tempS += * ( desVec + i + 6 ) * * ( desVec + i + 6 );  //desVec[8*i+6] * desVec[8*i+6];
-        tempS += * ( desVec + i + 7 ) * * ( desVec + i + 7 );  //desVec[8*i+7] * desVec[8*i+7];
-      }
+  /* construct line descriptor */
+  short desID;
 
-      tempM = 1 / sqrt( tempM );
-      tempS = 1 / sqrt( tempS );
-      desVec = &pSingleLine->descriptor.front();
-      base = 0;
-      for ( short i = 0; i < (short) ( NUM_OF_BANDS * 8 ); ++base, i = (short) ( base * 8 ) )
-      {
-        * ( desVec + i ) = * ( desVec + i ) * tempM;  //desVec[8*i] =  desVec[8*i] * tempM;
-        * ( desVec + 1 + i ) = * ( desVec + 1 + i ) * tempM;  //desVec[8*i+1] =  desVec[8*i+1] * tempM;
-        * ( desVec + 2 + i ) = * ( desVec + 2 + i ) * tempM;  //desVec[8*i+2] =  desVec[8*i+2] * tempM;
-        * ( desVec + 3 + i ) = * ( desVec + 3 + i ) * tempM;  //desVec[8*i+3] =  desVec[8*i+3] * tempM;
-        * ( desVec + 4 + i ) = * ( desVec + 4 + i ) * tempS;  //desVec[8*i+4] =  desVec[8*i+4] * tempS;
-        * ( desVec + 5 + i ) = * ( desVec + 5 + i ) * tempS;  //desVec[8*i+5] =  desVec[8*i+5] * tempS;
-        * ( desVec + 6 + i ) = * ( desVec + 6 + i ) * tempS;  //desVec[8*i+6] =  desVec[8*i+6] * tempS;
-        * ( desVec + 7 + i ) = * ( desVec + 7 + i ) * tempS;  //desVec[8*i+7] =  desVec[8*i+7] * tempS;
-      }
+  /*Note that the first and last bands only have (lengthOfLSP * widthOfBand_ * 2.0) pixels
+   * which are counted. */
+  float invN2 = (float) ( 1.0 / ( params.widthOfBand_ * 2.0 ) );
+  float invN3 = (float) ( 1.0 / ( params.widthOfBand_ * 3.0 ) );
+  float invN, temp;
+  for ( bandID = 0; bandID < NUM_OF_BANDS; bandID++ )
+  {
+    if( bandID == 0 || bandID == NUM_OF_BANDS - 1 )
+    {
+      invN = invN2;
+    }
+    else
+    {
+      invN = invN3;
+    }
+    desID = bandID * 8;
+    temp = pgdLBandSum[bandID] * invN;
+    desVec[desID] = temp;/* mean value of pgdL; */
+    desVec[desID + 4] = sqrt( pgdL2BandSum[bandID] * invN - temp * temp );  //std value of pgdL;
+    temp = ngdLBandSum[bandID] * invN;
+    desVec[desID + 1] = temp;  //mean value of ngdL;
+    desVec[desID + 5] = sqrt( ngdL2BandSum[bandID] * invN - temp * temp );  //std value of ngdL;
+
+    temp = pgdOBandSum[bandID] * invN;
+    desVec[desID + 2] = temp;  //mean value of pgdO;
+    desVec[desID + 6] = sqrt( pgdO2BandSum[bandID] * invN - temp * temp );  //std value of pgdO;
+    temp = ngdOBandSum[bandID] * invN;
+    desVec[desID + 3] = temp;  //mean value of ngdO;
+    desVec[desID + 7] = sqrt( ngdO2BandSum[bandID] * invN - temp * temp );  //std value of ngdO;
+  }
 
-      /* In order to reduce the influence of non-linear illumination,
-       * a threshold is used to limit the value of element in the unit feature
-       * vector no larger than this threshold. In Z.Wang's work, a value of 0.4 is found
-       * empirically to be a proper threshold.*/
-      desVec = &pSingleLine->descriptor.front();
-      for ( short i = 0; i < descriptor_size; i++ )
-      {
-        if( desVec[i] > 0.4 )
-        {
-          desVec[i] = (float) 0.4;
-        }
-      }
+  // normalize;
+  float tempM, tempS;
+  tempM = 0;
+  tempS = 0;
 
-      //re-normalize desVec;
-      temp = 0;
-      for ( short i = 0; i < descriptor_size; i++ )
-      {
-        temp += desVec[i] * desVec[i];
-      }
+  int base = 0;
+  for ( short i = 0; i < (short) ( NUM_OF_BANDS * 8 ); ++base, i = (short) ( base * 8 ) )
+  {
+    tempM += * ( desVec + i ) * * ( desVec + i );  //desVec[8*i+0] * desVec[8*i+0];
+    tempM += * ( desVec + i + 1 ) * * ( desVec + i + 1 );  //desVec[8*i+1] * desVec[8*i+1];
+    tempM += * ( desVec + i + 2 ) * * ( desVec + i + 2 );  //desVec[8*i+2] * desVec[8*i+2];
+    tempM += * ( desVec + i + 3 ) * * ( desVec + i + 3 );  //desVec[8*i+3] * desVec[8*i+3];
+    tempS += * ( desVec + i + 4 ) * * ( desVec + i + 4 );  //desVec[8*i+4] * desVec[8*i+4];
+    tempS += * ( desVec + i + 5 ) * * ( desVec + i + 5 );  //desVec[8*i+5] * desVec[8*i+5];
+    tempS += * ( desVec + i + 6 ) * * ( desVec + i + 6 );  //desVec[8*i+6] * desVec[8*i+6];
+    tempS += * ( desVec + i + 7 ) * * ( desVec + i + 7 );  //desVec[8*i+7] * desVec[8*i+7];
+  }
 
-      temp = 1 / sqrt( temp );
-      for ( short i = 0; i < descriptor_size; i++ )
-      {
-        desVec[i] = desVec[i] * temp;
-      }
-    }/* end for(short lineIDInSameLine = 0; lineIDInSameLine<sameLineSize;
-     lineIDInSameLine++) */
+  tempM = 1 / sqrt( tempM );
+  tempS = 1 / sqrt( tempS );
+  base = 0;
+  for ( short i = 0; i < (short) ( NUM_OF_BANDS * 8 ); ++base, i = (short) ( base * 8 ) )
+  {
+    * ( desVec + i ) = * ( desVec + i ) * tempM;  //desVec[8*i] =  desVec[8*i] * tempM;
+    * ( desVec + 1 + i ) = * ( desVec + 1 + i ) * tempM;  //desVec[8*i+1] =  desVec[8*i+1] * tempM;
+    * ( desVec + 2 + i ) = * ( desVec + 2 + i ) * tempM;  //desVec[8*i+2] =  desVec[8*i+2] * tempM;
+    * ( desVec + 3 + i ) = * ( desVec + 3 + i ) * tempM;  //desVec[8*i+3] =  desVec[8*i+3] * tempM;
+    * ( desVec + 4 + i ) = * ( desVec + 4 + i ) * tempS;  //desVec[8*i+4] =  desVec[8*i+4] * tempS;
+    * ( desVec + 5 + i ) = * ( desVec + 5 + i ) * tempS;  //desVec[8*i+5] =  desVec[8*i+5] * tempS;
+    * ( desVec + 6 + i ) = * ( desVec + 6 + i ) * tempS;  //desVec[8*i+6] =  desVec[8*i+6] * tempS;
+    * ( desVec + 7 + i ) = * ( desVec + 7 + i ) * tempS;  //desVec[8*i+7] =  desVec[8*i+7] * tempS;
+  }
 
-    cv::Mat appoggio = cv::Mat( 1, 32, CV_32FC1 );
-    float* pointerToRow = appoggio.ptr<float>( 0 );
-    for ( int g = 0; g < 32; g++ )
+  /* In order to reduce the influence of non-linear illumination,
+   * a threshold is used to limit the value of element in the unit feature
+   * vector no larger than this threshold. In Z.Wang's work, a value of 0.4 is found
+   * empirically to be a proper threshold.*/
+  for ( short i = 0; i < descriptor_size; i++ )
+  {
+    if( desVec[i] > 0.4 )
     {
-      /* get LBD data */
-      float* des_Vec = &keyLines[lineIDInScaleVec][0].descriptor.front();
-      *pointerToRow = des_Vec[g];
-      pointerToRow++;
-
+      desVec[i] = (float) 0.4;
     }
+  }
 
-  }/* end for(short lineIDInScaleVec = 0;
-   lineIDInScaleVec<numOfFinalLine; lineIDInScaleVec++) */
-
-  delete[] dL;
-  delete[] dO;
-  delete[] pgdLBandSum;
-  delete[] ngdLBandSum;
-  delete[] pgdL2BandSum;
-  delete[] ngdL2BandSum;
-  delete[] pgdOBandSum;
-  delete[] ngdOBandSum;
-  delete[] pgdO2BandSum;
-  delete[] ngdO2BandSum;
-
-  return 1;
+  //re-normalize desVec;
+  temp = 0;
+  for ( short i = 0; i < descriptor_size; i++ )
+  {
+    temp += desVec[i] * desVec[i];
+  }
 
+  temp = 1 / sqrt( temp );
+  for ( short i = 0; i < descriptor_size; i++ )
+  {
+    desVec[i] = desVec[i] * temp;
+  }
 }
 
 BinaryDescriptor::EDLineDetector::EDLineDetector()
@@ -42,8 +42,6 @@
 #include "precomp.hpp"
 
 #define MAX_B 37
-double ARRAY_RESIZE_FACTOR = 1.1;    // minimum is 1.0
-double ARRAY_RESIZE_ADD_FACTOR = 4;  // minimum is 1
 
 //using namespace cv;
 namespace cv
@@ -58,6 +56,7 @@ BinaryDescriptorMatcher::BinaryDescriptorMatcher()
   nextAddedIndex = 0;
   numImages = 0;
   descrInDS = 0;
+  maxThreads = 0;
 }
 
 /* constructor with smart pointer */
@@ -85,10 +84,13 @@ void BinaryDescriptorMatcher::train()
   if( !dataset )
     dataset = new Mihasher( 256, 32 );
 
+  /* keep the current dataset if there are no new descriptors */
   if( descriptorsMat.rows > 0 )
+  {
     dataset->populate( descriptorsMat, descriptorsMat.rows, descriptorsMat.cols );
+    descrInDS = descriptorsMat.rows;
+  }
 
-  descrInDS = descriptorsMat.rows;
   descriptorsMat.release();
 }
 
@@ -97,12 +99,23 @@ void BinaryDescriptorMatcher::clear()
 {
   descriptorsMat.release();
   indexesMap.clear();
+  delete dataset;
   dataset = 0;
   nextAddedIndex = 0;
   numImages = 0;
   descrInDS = 0;
 }
 
+int BinaryDescriptorMatcher::getMaxThreads() const
+{
+  return maxThreads;
+}
+
+void BinaryDescriptorMatcher::setMaxThreads( int nthreads )
+{
+  maxThreads = nthreads;
+}
+
 /* retrieve Hamming distances */
 void BinaryDescriptorMatcher::checkKDistances( UINT32 * numres, int k, std::vector<int> & k_distances, int row, int string_length ) const
 {
@@ -152,7 +165,7 @@ void BinaryDescriptorMatcher::match( const Mat& queryDescriptors, std::vector<DM
   UINT32 * numres = new UINT32[ ( 256 + 1 ) * ( queryDescriptors.rows )];
 
   /* execute query */
-  dataset->batchquery( results, numres, queryDescriptors, queryDescriptors.rows, queryDescriptors.cols );
+  dataset->batchquery( results, numres, queryDescriptors, queryDescriptors.rows, queryDescriptors.cols, maxThreads );
   /* compose matches */
   for ( int counter = 0; counter < queryDescriptors.rows; counter++ )
   {
@@ -224,7 +237,7 @@ void BinaryDescriptorMatcher::match( const Mat& queryDescriptors, const Mat& tra
   UINT32 * numres = new UINT32[ ( 256 + 1 ) * ( queryDescriptors.rows )];
 
   /* execute query */
-  mh->batchquery( results, numres, queryDescriptors, queryDescriptors.rows, queryDescriptors.cols );
+  mh->batchquery( results, numres, queryDescriptors, queryDescriptors.rows, queryDescriptors.cols, maxThreads );
 
   /* compose matches */
   for ( int counter = 0; counter < queryDescriptors.rows; counter++ )
@@ -288,7 +301,7 @@ void BinaryDescriptorMatcher::knnMatch( const Mat& queryDescriptors, const Mat&
   UINT32 * numres = new UINT32[ ( 256 + 1 ) * ( queryDescriptors.rows )];
 
   /* execute query */
-  mh->batchquery( results, numres, queryDescriptors, queryDescriptors.rows, queryDescriptors.cols );
+  mh->batchquery( results, numres, queryDescriptors, queryDescriptors.rows, queryDescriptors.cols, maxThreads );
 
   /* compose matches */
   int index = 0;
@@ -366,7 +379,7 @@ void BinaryDescriptorMatcher::knnMatch( const Mat& queryDescriptors, std::vector
   UINT32 * numres = new UINT32[ ( 256 + 1 ) * ( queryDescriptors.rows )];
 
   /* execute query */
-  dataset->batchquery( results, numres, queryDescriptors, queryDescriptors.rows, queryDescriptors.cols );
+  dataset->batchquery( results, numres, queryDescriptors, queryDescriptors.rows, queryDescriptors.cols, maxThreads );
 
   /* compose matches */
   int index = 0;
@@ -460,7 +473,7 @@ void BinaryDescriptorMatcher::radiusMatch( const Mat& queryDescriptors, const Ma
   UINT32 * numres = new UINT32[ ( 256 + 1 ) * ( queryDescriptors.rows )];
 
   /* execute query */
-  mh->batchquery( results, numres, queryDescriptors, queryDescriptors.rows, queryDescriptors.cols );
+  mh->batchquery( results, numres, queryDescriptors, queryDescriptors.rows, queryDescriptors.cols, maxThreads );
 
   /* compose matches */
   int index = 0;
@@ -535,7 +548,7 @@ void BinaryDescriptorMatcher::radiusMatch( const Mat& queryDescriptors, std::vec
   UINT32 * numres = new UINT32[ ( 256 + 1 ) * ( queryDescriptors.rows )];
 
   /* execute query */
-  dataset->batchquery( results, numres, queryDescriptors, queryDescriptors.rows, queryDescriptors.cols );
+  dataset->batchquery( results, numres, queryDescriptors, queryDescriptors.rows, queryDescriptors.cols, maxThreads );
 
   /* compose matches */
   int index = 0;
@@ -592,47 +605,59 @@ void BinaryDescriptorMatcher::radiusMatch( const Mat& queryDescriptors, std::vec
 
 }
 
-/* execute a batch query */
-void BinaryDescriptorMatcher::Mihasher::batchquery( UINT32 * results, UINT32 *numres, const cv::Mat & queries, UINT32 numq, int dim1queries )
+/* queries of a range of descriptors, with scratch buffers shared by all the queries of the range */
+class MihasherQueryInvoker : public ParallelLoopBody
 {
-  /* create and initialize a bitarray */
-  counter = new bitarray;
-  counter->init( N );
-
-  UINT32 *res = new UINT32[K * ( D + 1 )];
-  UINT64 *chunks = new UINT64[m];
-  UINT32 * presults = results;
-  UINT32 *pnumres = numres;
-
-  /* make a copy of input queries */
-  cv::Mat queries_clone = queries.clone();
-
-  /* set a pointer to first query (row) */
-  UINT8 *pq = queries_clone.ptr();
-
-  /* loop over number of descriptors */
-  for ( size_t i = 0; i < numq; i++ )
+ public:
+  MihasherQueryInvoker( BinaryDescriptorMatcher::Mihasher* _mh, UINT32* _results, UINT32* _numres, cv::Mat& _queries, int _dim1queries ) :
+      mh( _mh ),
+      results( _results ),
+      numres( _numres ),
+      queries( _queries.ptr() ),
+      dim1queries( _dim1queries )
   {
-    /* for every descriptor, query database */
-    query( presults, pnumres, pq, chunks, res );
-
-    /* move pointer to write next K indeces */
-    presults += K;
-    pnumres += B + 1;
+  }
 
-    /* move forward pointer to current row in descriptors matrix */
-    pq += dim1queries;
+  void operator()( const Range& range ) const
+  {
+    BinaryDescriptorMatcher::bitarray counter;
+    counter.init( mh->N );
+    std::vector<UINT32> res( mh->K * ( mh->D + 1 ) );
+    std::vector<UINT64> chunks( mh->m );
+    std::vector<int> power( mh->d + 1 );
 
+    for ( int i = range.start; i < range.end; i++ )
+      mh->query( results + (size_t) i * mh->K, numres + (size_t) i * ( mh->B + 1 ), queries + (size_t) i * dim1queries, &chunks[0], &res[0],
+                 &counter, &power[0] );
   }
 
-  delete[] res;
-  delete[] chunks;
+ private:
+  BinaryDescriptorMatcher::Mihasher* mh;
+  UINT32* results;
+  UINT32* numres;
+  UINT8* queries;
+  int dim1queries;
+};
+
+/* execute a batch query */
+void BinaryDescriptorMatcher::Mihasher::batchquery( UINT32 * results, UINT32 *numres, const cv::Mat & queries, UINT32 numq, int dim1queries,
+                                                    int nthreads )
+{
+  /* make a copy of input queries */
+  cv::Mat queries_clone = queries.clone();
 
-  delete counter;
+  /* split the queries among the threads (one stripe per thread) */
+  MihasherQueryInvoker invoker( this, results, numres, queries_clone, dim1queries );
+  int nstripes = nthreads < 1 ? getNumThreads() : std::min( nthreads, getNumThreads() );
+  if( nstripes <= 1 )
+    invoker( Range( 0, (int) numq ) );
+  else
+    parallel_for_( Range( 0, (int) numq ), invoker, nstripes );
 }
 
 /* execute a single query */
-void BinaryDescriptorMatcher::Mihasher::query( UINT32* results, UINT32* numres, UINT8 * Query, UINT64 *chunks, UINT32 *res )
+void BinaryDescriptorMatcher::Mihasher::query( UINT32* results, UINT32* numres, UINT8 * Query, UINT64 *chunks, UINT32 *res, bitarray * counter,
+                                               int * power )
 {
   /* if K == 0 that means we want everything to be processed.
    So maxres = N in that case. Otherwise K limits the results processed */
@@ -801,27 +826,21 @@ void BinaryDescriptorMatcher::Mihasher::populate( cv::Mat & _codes, UINT32 N_val
 {
   N = N_val;
   codes = _codes;
-  UINT64 * chunks = new UINT64[m];
 
+  /* split all the codes once */
+  std::vector<UINT64> chunks( (size_t) N * m );
   UINT8 * pcodes = codes.ptr();
   for ( UINT64 i = 0; i < N; i++, pcodes += dim1codes )
-  {
-    split( chunks, pcodes, m, mplus, b );
+    split( chunks.data() + i * m, pcodes, m, mplus, b );
 
-    for ( int k = 0; k < m; k++ )
-      H[k].insert( chunks[k], (UINT32) i );
-
-    if( i % (int) ceil( N / 1000.0 ) == 0 )
-      fflush (stdout);
-  }
-
-  delete[] chunks;
+  /* build every table from its substrings */
+  for ( int k = 0; k < m; k++ )
+    H[k].build( chunks.data() + k, (UINT32) N, m );
 }
 
 /* constructor */
 BinaryDescriptorMatcher::SparseHashtable::SparseHashtable()
 {
-  table = NULL;
   size = 0;
   b = 0;
 }
@@ -834,8 +853,9 @@ int BinaryDescriptorMatcher::SparseHashtable::init( int _b )
   if( b < 5 || b > MAX_B || b > (int) ( sizeof(UINT64) * 8 ) )
     return 1;
 
-  size = UINT64_1 << ( b - 5 );  // size = 2 ^ b
-  table = (BucketGroup*) calloc( (size_t)size, sizeof(BucketGroup) );
+  size = UINT64_1 << b;  // size = 2 ^ b
+  offsets.assign( (size_t) size + 1, 0 );
+  data.clear();
 
   return 0;
 
@@ -844,128 +864,31 @@ int BinaryDescriptorMatcher::SparseHashtable::init( int _b )
 /* destructor */
 BinaryDescriptorMatcher::SparseHashtable::~SparseHashtable()
 {
-  free (table);
 }
 
-/* insert data */
-void BinaryDescriptorMatcher::SparseHashtable::insert( UINT64 index, UINT32 data )
-{
-  table[index >> 5].insert( (int) ( index % 32 ), data );
-}
-
-/* query data */
-UINT32* BinaryDescriptorMatcher::SparseHashtable::query( UINT64 index, int *Size )
+/* build the table with a counting sort of the keys, which keeps the
+ codes sharing a key in increasing order of their index */
+void BinaryDescriptorMatcher::SparseHashtable::build( const UINT64* keys, UINT32 N, int stride )
 {
-  return table[index >> 5].query( (int) ( index % 32 ), Size );
-}
+  std::fill( offsets.begin(), offsets.end(), 0 );
+  for ( UINT32 i = 0; i < N; i++ )
+    offsets[keys[(size_t) i * stride] + 1]++;
 
-/* constructor */
-BinaryDescriptorMatcher::BucketGroup::BucketGroup()
-{
-  empty = 0;
-  group = std::vector < uint32_t > ( 2, 0 );
-}
+  for ( UINT64 j = 0; j < size; j++ )
+    offsets[j + 1] += offsets[j];
 
-/* destructor */
-BinaryDescriptorMatcher::BucketGroup::~BucketGroup()
-{
+  data.resize( N );
+  std::vector<UINT32> next( offsets.begin(), offsets.end() - 1 );
+  for ( UINT32 i = 0; i < N; i++ )
+    data[next[keys[(size_t) i * stride]]++] = i;
 }
 
-void BinaryDescriptorMatcher::BucketGroup::insert_value( std::vector<uint32_t>& vec, int index, UINT32 data )
-{
-  if( vec.size() > 1 )
-  {
-    if( vec[0] == vec[1] )
-    {
-      vec[1] = (UINT32) ceil( vec[0] * 1.1 );
-      for ( int i = 0; i < (int) ( 2 + vec[1] - vec.size() ); i++ )
-        vec.push_back( 0 );
-
-    }
-
-    vec.insert( vec.begin() + 2 + index, data );
-    vec[2 + index] = data;
-    vec[0]++;
-  }
-
-  else
-  {
-    vec = std::vector < uint32_t > ( 3, 0 );
-    vec[0] = 1;
-    vec[1] = 1;
-    vec[2] = data;
-  }
-}
-
-void BinaryDescriptorMatcher::BucketGroup::push_value( std::vector<uint32_t>& vec, UINT32 Data )
-{
-  if( vec.size() > 0 )
-  {
-    if( vec[0] == vec[1] )
-    {
-      vec[1] = (UINT32) std::max( ceil( vec[1] * ARRAY_RESIZE_FACTOR ), vec[1] + ARRAY_RESIZE_ADD_FACTOR );
-      for ( int i = 0; i < (int) ( 2 + vec[1] - vec.size() ); i++ )
-        vec.push_back( 0 );
-    }
-
-    vec[2 + vec[0]] = Data;
-    vec[0]++;
-
-  }
-
-  else
-  {
-    vec = std::vector < uint32_t > ( 2 + (uint32_t) ARRAY_RESIZE_ADD_FACTOR, 0 );
-    vec[0] = 1;
-    vec[1] = 1;
-    vec[2] = Data;
-  }
-}
-
-/* insert data into the bucket */
-void BinaryDescriptorMatcher::BucketGroup::insert( int subindex, UINT32 data )
-{
-  if( group.size() == 0 )
-  {
-    push_value( group, 0 );
-  }
-
-  UINT32 lowerbits = ( (UINT32) 1 << subindex ) - 1;
-  int end = popcnt( empty & lowerbits );
-
-  if( ! ( empty & ( (UINT32) 1 << subindex ) ) )
-  {
-    insert_value( group, end, group[end + 2] );
-    empty |= (UINT32) 1 << subindex;
-  }
-
-  int totones = popcnt( empty );
-  insert_value( group, totones + 1 + group[2 + end + 1], data );
-
-  for ( int i = end + 1; i < totones + 1; i++ )
-    group[2 + i]++;
-}
-
-/* perform a query to the bucket */
-UINT32* BinaryDescriptorMatcher::BucketGroup::query( int subindex, int *size )
+/* query data */
+UINT32* BinaryDescriptorMatcher::SparseHashtable::query( UINT64 index, int *Size )
 {
-  if( empty & ( (UINT32) 1 << subindex ) )
-  {
-    UINT32 lowerbits = ( (UINT32) 1 << subindex ) - 1;
-    int end = popcnt( empty & lowerbits );
-    int totones = popcnt( empty );
-
-    *size = group[2 + end + 1] - group[2 + end];
-    return & ( * ( group.begin() + 2 + totones + 1 + (int) group[2 + end] ) );
-  }
-
-  else
-  {
-    *size = 0;
-    return NULL;
-  }
+  *Size = (int) ( offsets[index + 1] - offsets[index] );
+  return *Size ? &data[offsets[index]] : NULL;
 }
 
 }
 }
-
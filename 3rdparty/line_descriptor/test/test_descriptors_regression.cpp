@@ -372,3 +372,50 @@ TEST( BinaryDescriptor_Descriptors, regression )
   CV_BD_DescriptorsTest<Hamming> test( std::string( "lbd_descriptors_cameraman" ), 1 );
   test.safe_run();
 }
+
+/* the vectorized LBD kernel must give the same floats as the scalar one, for random lines on random
+ gradients (lines crossing the border included, so the clamped lookups are exercised too) */
+TEST( BinaryDescriptor_Descriptors, vectorizedMatchesScalar )
+{
+  const int width = 317, height = 241;
+  RNG rng( 0x1bd );
+
+  std::vector<Mat> octaves( 1, Mat::zeros( height, width, CV_8UC1 ) );
+  std::vector<Mat> dx( 1, Mat( height, width, CV_16SC1 ) ), dy( 1, Mat( height, width, CV_16SC1 ) );
+  rng.fill( dx[0], RNG::UNIFORM, -1020, 1021 );
+  rng.fill( dy[0], RNG::UNIFORM, -1020, 1021 );
+
+  std::vector<KeyLine> keylines;
+  for ( int i = 0; i < 500; i++ )
+  {
+    KeyLine kl;
+    kl.sPointInOctaveX = rng.uniform( -10.f, width + 10.f );
+    kl.sPointInOctaveY = rng.uniform( -10.f, height + 10.f );
+    kl.ePointInOctaveX = rng.uniform( -10.f, width + 10.f );
+    kl.ePointInOctaveY = rng.uniform( -10.f, height + 10.f );
+    float ldx = kl.ePointInOctaveX - kl.sPointInOctaveX, ldy = kl.ePointInOctaveY - kl.sPointInOctaveY;
+    kl.angle = atan2( ldy, ldx );
+    kl.numOfPixels = (int) std::max( std::abs( ldx ), std::abs( ldy ) ) + 1;
+    kl.octave = 0;
+    keylines.push_back( kl );
+  }
+
+  Ptr<BinaryDescriptor> bd = BinaryDescriptor::createBinaryDescriptor();
+  bool useOptimized = cv::useOptimized();
+  Mat optimizedDescr, scalarDescr, optimizedBinary, scalarBinary;
+  cv::setUseOptimized( true );
+  bd->compute( octaves, dx, dy, keylines, optimizedDescr, true );
+  bd->compute( octaves, dx, dy, keylines, optimizedBinary );
+  cv::setUseOptimized( false );
+  bd->compute( octaves, dx, dy, keylines, scalarDescr, true );
+  bd->compute( octaves, dx, dy, keylines, scalarBinary );
+  cv::setUseOptimized( useOptimized );
+
+  ASSERT_EQ( scalarDescr.size(), optimizedDescr.size() );
+  ASSERT_EQ( scalarBinary.size(), optimizedBinary.size() );
+  for ( int i = 0; i < scalarDescr.rows; i++ )
+  {
+    EXPECT_EQ( 0, memcmp( scalarDescr.ptr( i ), optimizedDescr.ptr( i ), scalarDescr.cols * scalarDescr.elemSize() ) ) << "line " << i;
+    EXPECT_EQ( 0, memcmp( scalarBinary.ptr( i ), optimizedBinary.ptr( i ), scalarBinary.cols ) ) << "line " << i;
+  }
+}
@@ -577,3 +577,51 @@ TEST( BinaryDescriptor_Matcher, regression)
   CV_BinaryDescriptorMatcherTest test( 0.01f );
   test.safe_run();
 }
+
+/* the multi-index hashing search is exact: for descriptors clustered around a few seeds (so that the
+ hash tables have many codes per key, and exact duplicates), it must give the distances of a brute
+ force search at every rank; the matches at distance 0 come from a single key of the first table,
+ and must follow the increasing index order of the codes sharing a key, as the brute force does */
+TEST( BinaryDescriptor_Matcher, knnMatchMatchesBruteForce )
+{
+  const int k = 3;
+  RNG rng( 0x13 );
+  Mat seeds( 16, 32, CV_8UC1 ), train( 1500, 32, CV_8UC1 ), query( 300, 32, CV_8UC1 );
+  rng.fill( seeds, RNG::UNIFORM, 0, 256 );
+  for ( int i = 0; i < train.rows + query.rows; i++ )
+  {
+    uchar* row = ( i < train.rows ) ? train.ptr( i ) : query.ptr( i - train.rows );
+    memcpy( row, seeds.ptr( rng.uniform( 0, seeds.rows ) ), seeds.cols );
+    int nFlips = rng.uniform( 0, 6 );
+    for ( int f = 0; f < nFlips; f++ )
+      row[rng.uniform( 0, seeds.cols )] ^= (uchar) ( 1 << rng.uniform( 0, 8 ) );
+  }
+
+  std::vector<std::vector<DMatch> > reference, localMatches, trainedMatches;
+  BFMatcher( NORM_HAMMING ).knnMatch( query, train, reference, k );
+
+  Ptr<BinaryDescriptorMatcher> bdm = BinaryDescriptorMatcher::createBinaryDescriptorMatcher();
+  bdm->knnMatch( query, train, localMatches, k );
+  bdm->add( std::vector<Mat>( 1, train ) );
+  bdm->train();
+  bdm->knnMatch( query, trainedMatches, k );
+
+  const std::vector<std::vector<DMatch> >* results[] = { &localMatches, &trainedMatches };
+  for ( int t = 0; t < 2; t++ )
+  {
+    const std::vector<std::vector<DMatch> >& matches = *results[t];
+    ASSERT_EQ( reference.size(), matches.size() );
+    for ( size_t i = 0; i < matches.size(); i++ )
+    {
+      ASSERT_EQ( reference[i].size(), matches[i].size() ) << "query " << i;
+      for ( size_t r = 0; r < matches[i].size(); r++ )
+      {
+        const DMatch& m = matches[i][r];
+        EXPECT_EQ( reference[i][r].distance, m.distance ) << "query " << i << ", rank " << r;
+        EXPECT_EQ( m.distance, (float) norm( query.row( m.queryIdx ), train.row( m.trainIdx ), NORM_HAMMING ) ) << "query " << i << ", rank " << r;
+        if( reference[i][r].distance == 0 )
+          EXPECT_EQ( reference[i][r].trainIdx, m.trainIdx ) << "query " << i << ", rank " << r;
+      }
+    }
+  }
+}
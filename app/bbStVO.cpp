@@ -23,6 +23,8 @@
 #include <stereoFrame.h>
 #include <stereoFrameHandler.h>
 #include <sceneRepresentation.h>
+#include <boundedQueue.h>
+#include <thread>
 #include "yaml-cpp/yaml.h"
 
 using namespace StVO;
@@ -56,6 +58,26 @@ int main(int argc, char **argv)
     bbGrabber->grabStereo(img_l,img_r);
     StVO->initialize(img_l,img_r,0);
 
+    // in real-time mode the pairs are grabbed in background and only the newest one is tracked, the
+    // stale ones are dropped (the gaps in the frame indices are reported by StVO as skipped frames)
+    struct StereoPair { Mat img_l, img_r; int idx; };
+    BoundedQueue<StereoPair> pairs(1);
+    thread grabber_thread;
+    if( Config::realTime() )
+        grabber_thread = thread( [&]{
+            for( int idx = 1; ; idx++ )
+            {
+                StereoPair pair;
+                bbGrabber->grabStereo(pair.img_l,pair.img_r);
+                // the grabbed images point into the buffer of the grabber, overwritten by the next grab
+                pair.img_l = pair.img_l.clone();
+                pair.img_r = pair.img_r.clone();
+                pair.idx = idx;
+                if( pairs.pushLatest( pair ) < 0 )
+                    break;
+            }
+        } );
+
     // run PL-StVO
     mrpt::utils::CTicTac clock;
     int frame_counter = 1;
@@ -63,14 +85,24 @@ int main(int argc, char **argv)
     {
         // Point-Line Tracking
         clock.Tic();
-        bbGrabber->grabStereo(img_l,img_r);
+        if( Config::realTime() )
+        {
+            StereoPair pair;
+            if( !pairs.pop( pair ) )
+                break;
+            img_l = pair.img_l;
+            img_r = pair.img_r;
+            frame_counter = pair.idx;
+        }
+        else
+            bbGrabber->grabStereo(img_l,img_r);
         double t0 = 1000 * clock.Tac(); //ms
         StVO->insertStereoPair( img_l, img_r, frame_counter );
         StVO->optimizePose();
         double t1 = 1000 * clock.Tac(); //ms
 
         // update scene
-        scene.setText(frame_counter,t1,StVO->n_inliers_pt,StVO->matched_pt.size(),StVO->n_inliers_ls,StVO->matched_ls.size());
+        scene.setText(frame_counter,t1,StVO->n_inliers_pt,StVO->matched.nPoints(),StVO->n_inliers_ls,StVO->matched.nLines());
         scene.setCov( cov );
         scene.setPose( StVO->curr_frame->DT );
         imwrite("../config/aux/img_aux.png",StVO->curr_frame->plotStereoFrame());
@@ -84,8 +116,11 @@ int main(int argc, char **argv)
         cout.setf(ios::fixed,ios::floatfield); cout.precision(3);
         cout << " \t BB grabber time: " << t0 << " ms ";
         cout << " \t Proc. time: " << t1-t0 << " ms\t ";
-        cout << "\t Points: " << StVO->matched_pt.size() << " (" << StVO->n_inliers_pt << ") " <<
-                "\t Lines:  " << StVO->matched_ls.size() << " (" << StVO->n_inliers_ls << ") " << endl;
+        cout << "\t Points: " << StVO->matched.nPoints() << " (" << StVO->n_inliers_pt << ") " <<
+                "\t Lines:  " << StVO->matched.nLines() << " (" << StVO->n_inliers_ls << ") " << endl;
+        if( Config::realTime() )
+            cout << "\t Skipped frames: " << StVO->n_skipped_frames << " \t Degraded frames: " << StVO->n_degraded_frames
+                 << ( StVO->curr_frame->budget.degraded() ? ( StVO->curr_frame->budget.points ? " (points only)" : " (lines only)" ) : "" ) << endl;
 
         // update StVO
         StVO->updateFrame();
@@ -93,6 +128,10 @@ int main(int argc, char **argv)
 
     }
 
+    pairs.close();
+    if( grabber_thread.joinable() )
+        grabber_thread.join();
+
     return 0;
 
 }
@@ -26,6 +26,7 @@
 
 #include <stereoFrame.h>
 #include <stereoFrameHandler.h>
+#include <stereoImageReader.h>
 #include <ctime>
 #include <boost/fusion/include/vector.hpp>
 #include <boost/fusion/include/at_c.hpp>
@@ -235,79 +236,118 @@ int main(int argc, char **argv)
 
     // initialize and run PL-StVO
     int frame_counter = 0;
-    double t1;
+    double t1 = 0.0;
     StereoFrameHandler* StVO = new StereoFrameHandler(cam_pin);
+    // the images are decoded and rectified (if distorted) in background, ahead of the tracker
+    vector<string> paths_l, paths_r;
     for (std::map<std::string, std::string>::iterator it_l = sorted_imgs_l.begin(), it_r = sorted_imgs_r.begin();
-         it_l != sorted_imgs_l.end(), it_r != sorted_imgs_r.end(); ++it_l, ++it_r, frame_counter++)
+         it_l != sorted_imgs_l.end(), it_r != sorted_imgs_r.end(); ++it_l, ++it_r)
     {
+        paths_l.push_back( ( img_dir_path_l / boost::filesystem::path(it_l->second.c_str()) ).string() );
+        paths_r.push_back( ( img_dir_path_r / boost::filesystem::path(it_r->second.c_str()) ).string() );
+    }
+    StereoImageReader reader( paths_l, paths_r, cam_pin, Config::prefetchPairs(), Config::prefetchThreads() );
+    // optimizes, displays and retires the frame being tracked
+    auto trackFrame = [&]()
+    {
+        // set GT initial pose
+        //Matrix4d gt_inc = inverse_se3( GTposes[frame_counter] ) * GTposes[frame_counter-1];
 
-        // load images
-        boost::filesystem::path img_path_l = img_dir_path_l / boost::filesystem::path(it_l->second.c_str());
-        boost::filesystem::path img_path_r = img_dir_path_r / boost::filesystem::path(it_r->second.c_str());
-        Mat img_l( imread(img_path_l.string(), CV_LOAD_IMAGE_UNCHANGED) );  assert(!img_l.empty()); // it depends on the OpenCV version!!!
-        Mat img_r( imread(img_path_r.string(), CV_LOAD_IMAGE_UNCHANGED) );  assert(!img_r.empty());
-
-        // if images are distorted
-        Mat img_l_rec, img_r_rec;
-        cam_pin->rectifyImagesLR(img_l,img_l_rec,img_r,img_r_rec);
+        // solve with robust kernel and IRLS
+        StVO->optimizePose();
+        T_inc   = StVO->curr_frame->DT;
+        cov     = StVO->curr_frame->DT_cov;
+        cov_eig = StVO->curr_frame->DT_cov_eig;
 
-        // initialize (TODO: out of the for loop)
-        if( frame_counter == 0 )
-            StVO->initialize(img_l_rec,img_r_rec,0);
-        // run
+        // processing time of this frame; when pipelined, it was extracted in background while older frames
+        // were tracked, so the time is the sum of its own stages
+        if( Config::usePipeline() )
+        {
+            const FeatureBudget::Timing &t = StVO->curr_frame->timing;
+            t1 = t.extraction + t.tracking + t.optimization;
+        }
         else
         {
-            // PL-StVO
             #ifdef HAS_MRPT
-            clock.Tic();
+            t1 = 1000 * clock.Tac(); //ms
             #endif
-            StVO->insertStereoPair( img_l_rec, img_r_rec, frame_counter );
+        }
 
-            // set GT initial pose
-            //Matrix4d gt_inc = inverse_se3( GTposes[frame_counter] ) * GTposes[frame_counter-1];
+        // update scene
+        #ifdef HAS_MRPT
+        scene.setText(StVO->curr_frame->frame_idx,t1,StVO->n_inliers_pt,StVO->matched.nPoints(),StVO->n_inliers_ls,StVO->matched.nLines());
+        scene.setCov( cov );
+        scene.setPose( T_inc );
+        imwrite("../config/aux/img_aux.png",StVO->curr_frame->plotStereoFrame());
+        scene.setImage( "../config/aux/img_aux.png" );
+        //scene.setImage( img_path_l.string() );
+        if(has_gt)
+            scene.setGT( GTposes[StVO->curr_frame->frame_idx] );
+        scene.updateScene();
+        // insert Keyframe when necessary
+        /*if( StVO->needNewKF() ){
+            StVO->currFrameIsKF();
+            scene.setKF();
+        }*/
+        #endif
 
-            // solve with robust kernel and IRLS
-            StVO->optimizePose();
-            T_inc   = StVO->curr_frame->DT;
-            cov     = StVO->curr_frame->DT_cov;
-            cov_eig = StVO->curr_frame->DT_cov_eig;
+        // console output
+        cout.setf(ios::fixed,ios::floatfield); cout.precision(8);
+        cout << "Frame: " << StVO->curr_frame->frame_idx << " \t Residual error: " << StVO->curr_frame->err_norm;
+        cout.setf(ios::fixed,ios::floatfield); cout.precision(3);
+        cout << " \t Proc. time: " << t1 << " ms\t ";
+        cout << "\t Points: " << StVO->matched.nPoints() << " (" << StVO->n_inliers_pt << ") " <<
+                "\t Lines:  " << StVO->matched.nLines() << " (" << StVO->n_inliers_ls << ") " << endl;
 
-            #ifdef HAS_MRPT
-            t1 = 1000 * clock.Tac(); //ms
-            #endif
+        // budget the frame was extracted with and time of its stages
+        if( Config::budgetControl() )
+        {
+            const FeatureBudget::Values &b = StVO->curr_frame->budget;
+            const FeatureBudget::Timing &t = StVO->curr_frame->timing;
+            cout << "\t Budget: " << b.orb_nfeatures << " points, " << b.min_line_length << " min. line length, " << b.lsd_scale << " LSD scale "
+                 << "\t Stages: " << t.extraction << " / " << t.tracking << " / " << t.optimization << " ms" << endl;
+        }
 
-            // update scene
-            #ifdef HAS_MRPT
-            scene.setText(frame_counter,t1,StVO->n_inliers_pt,StVO->matched_pt.size(),StVO->n_inliers_ls,StVO->matched_ls.size());
-            scene.setCov( cov );
-            scene.setPose( T_inc );
-            imwrite("../config/aux/img_aux.png",StVO->curr_frame->plotStereoFrame());
-            scene.setImage( "../config/aux/img_aux.png" );
-            //scene.setImage( img_path_l.string() );
-            if(has_gt)
-                scene.setGT( GTposes[frame_counter] );
-            scene.updateScene();
-            // insert Keyframe when necessary
-            /*if( StVO->needNewKF() ){
-                StVO->currFrameIsKF();
-                scene.setKF();
-            }*/
-            #endif
+        // update StVO
+        StVO->updateFrame();
+    };
 
-            // console output
-            cout.setf(ios::fixed,ios::floatfield); cout.precision(8);
-            cout << "Frame: " << frame_counter << " \t Residual error: " << StVO->curr_frame->err_norm;
-            cout.setf(ios::fixed,ios::floatfield); cout.precision(3);
-            cout << " \t Proc. time: " << t1 << " ms\t ";
-            cout << "\t Points: " << StVO->matched_pt.size() << " (" << StVO->n_inliers_pt << ") " <<
-                    "\t Lines:  " << StVO->matched_ls.size() << " (" << StVO->n_inliers_ls << ") " << endl;
+    Mat img_l_rec, img_r_rec;
+    for( ; reader.nextStereoPair( img_l_rec, img_r_rec ); frame_counter++ )
+    {
 
-            // update StVO
-            StVO->updateFrame();
+        // load images
+        assert(!img_l_rec.empty()); // it depends on the OpenCV version!!!
+        assert(!img_r_rec.empty());
 
+        // initialize (TODO: out of the for loop)
+        if( frame_counter == 0 )
+            StVO->initialize(img_l_rec,img_r_rec,0);
+        // run
+        else
+        {
+            // PL-StVO
+            // when pipelined, a frame is only ready once the pipeline is full
+            if( Config::usePipeline() )
+            {
+                if( StVO->insertStereoPairPipelined( img_l_rec, img_r_rec, frame_counter ) )
+                    trackFrame();
+            }
+            else
+            {
+                #ifdef HAS_MRPT
+                clock.Tic();
+                #endif
+                StVO->insertStereoPair( img_l_rec, img_r_rec, frame_counter );
+                trackFrame();
+            }
         }
     }
 
+    // track the frames still in flight in the pipeline
+    while( StVO->flushStereoPair() )
+        trackFrame();
+
     // wait until the scene is closed
     #ifdef HAS_MRPT
     while( scene.isOpen() );
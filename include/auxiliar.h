@@ -107,6 +107,13 @@ struct sort_descriptor_by_trainIdx
     }
 };
 
+struct sort_keypoints_by_response
+{
+    inline bool operator()(const KeyPoint& a, const KeyPoint& b){
+        return ( a.response > b.response );
+    }
+};
+
 struct sort_confmat_by_score
 {
     inline bool operator()(const Vector2d& a, const Vector2d& b){
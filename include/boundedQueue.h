@@ -0,0 +1,110 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#pragma once
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+using namespace std;
+
+namespace StVO{
+
+// FIFO queue with a fixed capacity shared between producer and consumer threads:
+// push() blocks while the queue is full (backpressure) and pop() blocks while it
+// is empty, until the queue is closed. Real-time producers use pushLatest() instead,
+// which never blocks and drops the oldest items.
+template <typename T>
+class BoundedQueue
+{
+
+public:
+
+    BoundedQueue( size_t capacity_ ) : capacity(capacity_), closed(false) {}
+    ~BoundedQueue(){}
+
+    // returns false if the queue was closed before the item could be inserted
+    bool push( T item )
+    {
+        unique_lock<mutex> lock(mtx);
+        not_full.wait( lock, [this]{ return closed || items.size() < capacity; } );
+        if( closed )
+            return false;
+        items.push_back( std::move(item) );
+        not_empty.notify_one();
+        return true;
+    }
+
+    // inserts the item dropping the oldest ones if the queue is full, returns the number of dropped
+    // items (or -1 if the queue was closed)
+    int pushLatest( T item )
+    {
+        unique_lock<mutex> lock(mtx);
+        if( closed )
+            return -1;
+        int n_dropped = 0;
+        while( !items.empty() && items.size() >= capacity )
+        {
+            items.pop_front();
+            n_dropped++;
+        }
+        items.push_back( std::move(item) );
+        not_empty.notify_one();
+        return n_dropped;
+    }
+
+    // returns false once the queue is closed and there are no items left
+    bool pop( T &item )
+    {
+        unique_lock<mutex> lock(mtx);
+        not_empty.wait( lock, [this]{ return closed || !items.empty(); } );
+        if( items.empty() )
+            return false;
+        item = std::move( items.front() );
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        lock_guard<mutex> lock(mtx);
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+    size_t size()
+    {
+        lock_guard<mutex> lock(mtx);
+        return items.size();
+    }
+
+private:
+
+    const size_t            capacity;
+    bool                    closed;
+    deque<T>                items;
+    mutex                   mtx;
+    condition_variable      not_full, not_empty;
+
+};
+
+}
@@ -22,6 +22,7 @@
 #pragma once
 #include <cmath>
 #include <string>
+#include <thread>
 
 using namespace std;
 
@@ -48,11 +49,21 @@ public:
     static bool&    scalePointsLines()  { return getInstance().scale_points_lines; }
     static bool&    useUncertainty()    { return getInstance().use_uncertainty; }
     static bool&    useBFMLines()       { return getInstance().use_bfm_lines; }
+    static bool&    usePipeline()       { return getInstance().use_pipeline; }
+    static bool&    useSIMDMatcher()    { return getInstance().use_simd_matcher; }
+    static bool&    stereoBandMatch()   { return getInstance().stereo_band_match; }
+    static bool&    guidedF2F()         { return getInstance().guided_f2f; }
+    static bool&    budgetControl()     { return getInstance().budget_control; }
+    static bool&    realTime()          { return getInstance().real_time; }
+    static bool&    useLevMarquardt()   { return getInstance().use_lev_marquardt; }
+    static bool&    irlsOutliers()      { return getInstance().irls_outliers; }
 
     // points detection and matching
     static int&     orbNFeatures()      { return getInstance().orb_nfeatures; }
     static double&  orbScaleFactor()    { return getInstance().orb_scale_factor; }
     static int&     orbNLevels()        { return getInstance().orb_nlevels; }
+    static int&     orbGridCols()       { return getInstance().orb_grid_cols; }
+    static int&     orbGridRows()       { return getInstance().orb_grid_rows; }
     static int&     brsThreshold()      { return getInstance().brs_threshold; }
     static double&  brsScaleFactor()    { return getInstance().brs_scale_factor; }
     static int&     brsNLevels()        { return getInstance().brs_nlevels; }
@@ -60,6 +71,7 @@ public:
     static double&  minDisp()           { return getInstance().min_disp; }
     static double&  minRatio12P()       { return getInstance().min_ratio_12_p; }
     static double&  maxF2FDisp()        { return getInstance().max_f2f_disp; }
+    static double&  f2fGuidedWin()      { return getInstance().f2f_guided_win; }
 
     // lines detection and matching
     static int&     lsdRefine()         { return getInstance().lsd_refine; }
@@ -70,6 +82,13 @@ public:
     static double&  lsdLogEps()         { return getInstance().lsd_log_eps; }
     static double&  lsdDensityTh()      { return getInstance().lsd_density_th; }
     static int&     lsdNBins()          { return getInstance().lsd_n_bins; }
+    static int&     lsdGridCols()       { return getInstance().lsd_grid_cols; }
+    static int&     lsdGridRows()       { return getInstance().lsd_grid_rows; }
+    static int&     lsdTileOverlap()    { return getInstance().lsd_tile_overlap; }
+    static double&  lsdMergeAngTh()     { return getInstance().lsd_merge_ang_th; }
+    static double&  lsdMergeDistTh()    { return getInstance().lsd_merge_dist_th; }
+    static int&     lsdCoarseOctave()   { return getInstance().lsd_coarse_octave; }
+    static double&  lsdCoarseBand()     { return getInstance().lsd_coarse_band; }
     static double&  minHorizAngle()     { return getInstance().min_horiz_angle; }
     static double&  maxAngleDiff()      { return getInstance().max_angle_diff; }
     static double&  maxF2FAngDiff()     { return getInstance().max_f2f_ang_diff; }
@@ -96,11 +115,29 @@ public:
     static int&     maxItersRef()       { return getInstance().max_iters_ref; }
     static double&  minError()          { return getInstance().min_error; }
     static double&  minErrorChange()    { return getInstance().min_error_change; }
+    static double&  minGradNorm()       { return getInstance().min_grad_norm; }
+    static double&  minRelStep()        { return getInstance().min_rel_step; }
     static double&  inlierK()           { return getInstance().inlier_k; }
     static double&  sigmaPx()           { return getInstance().sigma_px; }
     static double&  maxOptimError()     { return getInstance().max_optim_error; }
     static double&  maxCovEigval()      { return getInstance().max_cov_eigval; }
 
+    // multi-threading
+    static int&     pipelineDepth()     { return getInstance().pipeline_depth; }
+    static int&     pipelineWorkers()   { return getInstance().pipeline_workers; }
+    static int&     numThreads()        { return getInstance().num_threads; }
+    static int&     prefetchPairs()     { return getInstance().prefetch_pairs; }
+    static int&     prefetchThreads()   { return getInstance().prefetch_threads; }
+
+    // feature budget control
+    static double&  budgetTargetMs()    { return getInstance().budget_target_ms; }
+    static double&  budgetGain()        { return getInstance().budget_gain; }
+    static double&  budgetMinScale()    { return getInstance().budget_min_scale; }
+    static double&  budgetMaxScale()    { return getInstance().budget_max_scale; }
+    static double&  budgetInlierMargin(){ return getInstance().budget_inlier_margin; }
+    static double&  rtDeadlineMs()      { return getInstance().rt_deadline_ms; }
+    static int&     rtDegradedFrames()  { return getInstance().rt_degraded_frames; }
+
 private:
 
     // SLAM parameters
@@ -153,11 +190,21 @@ private:
     bool use_uncertainty;
     bool is_outdoor;
     bool use_bfm_lines;
+    bool use_pipeline;
+    bool use_simd_matcher;
+    bool stereo_band_match;
+    bool guided_f2f;
+    bool budget_control;
+    bool real_time;
+    bool use_lev_marquardt;
+    bool irls_outliers;
 
     // points detection and matching
     int    orb_nfeatures;
     double orb_scale_factor;
     int    orb_nlevels;
+    int    orb_grid_cols;
+    int    orb_grid_rows;
     int    brs_threshold;
     double brs_scale_factor;
     int    brs_nlevels;
@@ -165,6 +212,7 @@ private:
     double min_disp;
     double min_ratio_12_p;
     double max_f2f_disp;
+    double f2f_guided_win;
 
     // lines detection and matching
     int    lsd_refine;
@@ -175,6 +223,13 @@ private:
     double lsd_log_eps;
     double lsd_density_th;
     int    lsd_n_bins;
+    int    lsd_grid_cols;
+    int    lsd_grid_rows;
+    int    lsd_tile_overlap;
+    double lsd_merge_ang_th;
+    double lsd_merge_dist_th;
+    int    lsd_coarse_octave;
+    double lsd_coarse_band;
     int    edl_ksize;
     double edl_sigma;
     int    edl_gradient_th;
@@ -201,10 +256,28 @@ private:
     int    max_iters_ref;
     double min_error;
     double min_error_change;
+    double min_grad_norm;
+    double min_rel_step;
     double inlier_k;
     double sigma_px;
     double max_optim_error;
     double max_cov_eigval;
 
+    // multi-threading
+    int    pipeline_depth;
+    int    pipeline_workers;
+    int    num_threads;
+    int    prefetch_pairs;
+    int    prefetch_threads;
+
+    // feature budget control
+    double budget_target_ms;
+    double budget_gain;
+    double budget_min_scale;
+    double budget_max_scale;
+    double budget_inlier_margin;
+    double rt_deadline_ms;
+    int    rt_degraded_frames;
+
 };
 
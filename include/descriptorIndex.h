@@ -0,0 +1,60 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#pragma once
+#include <vector>
+#include <mutex>
+using namespace std;
+
+#include <opencv/cv.h>
+#include <opencv2/line_descriptor.hpp>
+#include <opencv2/line_descriptor/descriptor.hpp>
+using namespace cv;
+using namespace cv::line_descriptor;
+
+namespace StVO{
+
+// Multi-index hashing tables of a set of binary descriptors, built once and queried as the train
+// set of any number of k-NN searches (e.g. the left line descriptors of a frame, used both when
+// it is the current and the previous frame of the f2f tracking). Queries are serialized, since
+// the hasher keeps per-query state.
+class DescriptorIndex
+{
+
+public:
+
+    DescriptorIndex();
+    ~DescriptorIndex();
+
+    void build( const Mat &desc );
+    void clear();
+    bool empty() const { return n_desc == 0; }
+    void knnMatch( const Mat &query, vector<vector<DMatch>> &matches, int k, int max_threads = 0 );   // max_threads < 1: all of OpenCV's threads
+
+private:
+
+    Ptr<BinaryDescriptorMatcher> bdm;
+    int   n_desc;
+    mutex mtx;
+
+};
+
+}
@@ -0,0 +1,74 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#pragma once
+#include <vector>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <cstddef>
+#include <stdint.h>
+using namespace std;
+
+namespace StVO{
+
+// Bump allocator for the features of a frame: objects are placed one after another in large
+// blocks and are never destroyed individually (only trivially destructible data is expected),
+// the whole arena is rewound at once when the frame is retired and its blocks are reused by
+// the next frames through a shared pool.
+class FeatureArena
+{
+
+public:
+
+    FeatureArena( size_t block_size_ = 1 << 18 );
+    ~FeatureArena();
+
+    // arenas recycled between frames
+    static FeatureArena* acquire();
+    static void          recycle( FeatureArena* arena );
+
+    template <typename T, typename... Args>
+    T* create( Args&&... args )
+    {
+        return new ( allocate( sizeof(T) ) ) T( std::forward<Args>(args)... );
+    }
+
+    void* allocate( size_t size );
+    void  reset();
+
+    static const size_t alignment = 32;
+
+private:
+
+    FeatureArena( const FeatureArena& );
+    FeatureArena& operator=( const FeatureArena& );
+
+    vector<char*>  blocks;
+    vector<size_t> capacities;
+    size_t         block_size;
+    size_t         curr_block;
+    size_t         offset;
+    mutex          mtx;      // points and lines of a frame are created by concurrent tasks
+
+};
+
+}
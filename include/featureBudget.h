@@ -0,0 +1,84 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#pragma once
+#include <chrono>
+using namespace std;
+
+#include <config.h>
+
+namespace StVO{
+
+// Closed-loop controller of the feature budget of each frame: the measured time of its stages
+// drives a scale of the nominal budget (Config) towards the target frame time, which sets the
+// number of ORB features, the min. line length and the LSD scale of the next frames. The budget
+// never shrinks while the inliers are close to the minimum needed by the optimizer. In real-time
+// mode, a frame that misses its deadline makes the next ones track a single kind of feature.
+class FeatureBudget
+{
+
+public:
+
+    typedef chrono::steady_clock Clock;
+
+    // budget of a frame
+    struct Values
+    {
+        bool degraded() const { return !points || !lines; }
+        bool   points;              // false if the frame does not extract points (degraded)
+        bool   lines;               // false if the frame does not extract lines (degraded)
+        int    orb_nfeatures;
+        double min_line_length;     // relative to img size
+        double lsd_scale;
+    };
+
+    // measured time of the stages of a frame (ms)
+    struct Timing
+    {
+        Timing() : extraction(0.0), tracking(0.0), optimization(0.0) {}
+        double total() const { return extraction + tracking + optimization; }
+        double extraction;
+        double tracking;
+        double optimization;
+    };
+
+    FeatureBudget();
+    ~FeatureBudget();
+
+    static Values nominal();
+    static double elapsedMs( const Clock::time_point &t0 );
+
+    void   update( const Timing &timing, int n_inliers_pt, int n_inliers_ls );
+    Values current() const { return values; }
+    double getScale() const { return scale; }
+
+private:
+
+    static Values scaled( double scale );
+
+    double scale;
+    Values values;
+    int    degraded_left;           // remaining frames of the degraded mode
+    bool   degraded_points;         // feature kept by the degraded mode
+
+};
+
+}
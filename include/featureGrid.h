@@ -0,0 +1,53 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#pragma once
+#include <vector>
+using namespace std;
+
+#include <eigen3/Eigen/Core>
+using namespace Eigen;
+
+namespace StVO{
+
+// Uniform grid of square cells over the image, storing the indices of the features whose
+// position falls in each cell, to retrieve the features inside a window without a full scan.
+class FeatureGrid
+{
+
+public:
+
+    FeatureGrid( int width, int height, double cell_size );
+    ~FeatureGrid();
+
+    void insert( int idx, const Vector2d &x );
+    void query( const Vector2d &x, double radius, vector<int> &indices ) const;   // square window, sorted indices
+
+private:
+
+    int    n_cols, n_rows;
+    double cell_size;
+    vector< vector<int> > cells;
+    vector<double>        pos_x, pos_y;
+
+};
+
+}
@@ -0,0 +1,57 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#pragma once
+#include <vector>
+using namespace std;
+
+#include <opencv/cv.h>
+#include <opencv2/features2d/features2d.hpp>
+using namespace cv;
+
+namespace StVO{
+
+// Brute-force k-NN matcher specialised for 256-bit binary descriptors (ORB and LBD, 32 bytes per
+// row), with the same output as BFMatcher(NORM_HAMMING)::knnMatch. The train descriptors are
+// interleaved by 64-bit words in blocks of 8, so that the distances from a query to a whole block
+// are computed with a few SIMD instructions (AVX-512 VPOPCNTDQ, AVX2 nibble LUT or scalar popcount,
+// depending on the target), and the query x train loop runs over chunks of train blocks that stay
+// in the L1 cache.
+//
+// knnMatchBidirectional computes every distance of desc_1 x desc_2 once and keeps both the k best
+// matches of each row (1->2) and of each column (2->1), i.e. the same output as two knnMatch calls
+// for the left-right consistency check. knnMatchCandidates does the same but only evaluates, for
+// each descriptor i of desc_1, the descriptors of desc_2 listed in candidates[i] (any length).
+class HammingMatcher
+{
+
+public:
+
+    static bool isSupported( const Mat &desc );
+    static void knnMatch( const Mat &query, const Mat &train, vector<vector<DMatch>> &matches, int k );
+    static void knnMatchBidirectional( const Mat &desc_1, const Mat &desc_2, vector<vector<DMatch>> &matches_12,
+                                       vector<vector<DMatch>> &matches_21, int k, bool parallel = false );
+    static void knnMatchCandidates( const Mat &desc_1, const Mat &desc_2, const vector<vector<int>> &candidates,
+                                    vector<vector<DMatch>> &matches_12, vector<vector<DMatch>> &matches_21, int k );
+
+};
+
+}
@@ -0,0 +1,55 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#pragma once
+#include <vector>
+using namespace std;
+
+#include <opencv/cv.h>
+using namespace cv;
+
+namespace StVO{
+
+// Pyramid of a (grayscale) image computed once per frame and shared by the feature extractors:
+// the raw octaves read by the line detector, and the smoothed octaves with their Sobel
+// derivatives read by the line descriptor.
+class ImagePyramid
+{
+
+public:
+
+    ImagePyramid();
+    ImagePyramid( const Mat &img, int n_octaves = 1, int ratio = 2 );
+    ~ImagePyramid();
+
+    void compute( const Mat &img, int n_octaves = 1, int ratio = 2 );
+    void computeGradients();
+    bool hasGradients() const { return !dx.empty(); }
+    int  size() const { return octaves.size(); }
+
+    int ratio;
+    vector<Mat> octaves;            // raw image and its pyrDown reductions
+    vector<Mat> smoothed;           // gaussian blurred image and its pyrDown reductions
+    vector<Mat> dx, dy;             // Sobel derivatives (CV_16SC1) of the smoothed octaves
+
+};
+
+}
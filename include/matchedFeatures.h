@@ -0,0 +1,77 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#pragma once
+#include <list>
+#include <vector>
+using namespace std;
+
+#include <eigen3/Eigen/Core>
+using namespace Eigen;
+
+#include <stereoFeatures.h>
+
+namespace StVO{
+
+typedef vector< double, aligned_allocator<double> > AlignedVectord;
+typedef vector< Matrix3d, aligned_allocator<Matrix3d> > AlignedVectorM3d;
+
+// Contiguous (structure-of-arrays) copy of the features matched between two frames, read by
+// the pose optimizer: one array per coordinate and a byte mask for the inliers. The features
+// it was built from are kept to write the inlier mask back to them.
+class MatchedFeatures
+{
+
+public:
+
+    MatchedFeatures();
+    ~MatchedFeatures();
+
+    void clear();
+    void assign( const list<PointFeature*> &matched_pt, const list<LineFeature*> &matched_ls );
+    void writeInliers();
+
+    int  nPoints() const { return pt_src.size(); }
+    int  nLines()  const { return ls_src.size(); }
+
+    // point features: 3D point in the previous frame, its back-projection covariance, and observation in the current one
+    AlignedVectord   pt_X, pt_Y, pt_Z;
+    AlignedVectorM3d pt_cov;
+    AlignedVectord   pt_u_obs, pt_v_obs;
+    AlignedVectord   pt_res;       // projection error of the last evaluation of the cost
+    vector<char>     pt_inlier;
+
+    // line segment features: 3D endpoints in the previous frame, their back-projection covariances,
+    // and coefficients of the line observed in the current one
+    AlignedVectord   ls_sX, ls_sY, ls_sZ, ls_eX, ls_eY, ls_eZ;
+    AlignedVectorM3d ls_scov, ls_ecov;
+    AlignedVectord   ls_lx, ls_ly, ls_lz;
+    AlignedVectord   ls_res;       // line projection error of the last evaluation of the cost
+    vector<char>     ls_inlier;
+
+private:
+
+    vector<PointFeature*> pt_src;
+    vector<LineFeature*>  ls_src;
+
+};
+
+}
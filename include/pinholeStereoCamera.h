@@ -65,6 +65,7 @@ public:
     // Proyection and Back-projection
     Vector3d backProjection_unit(const double &u, const double &v, const double &disp, double &depth);
     Vector3d backProjection(const double &u, const double &v, const double &disp);
+    Matrix3d backProjectionCov(const double &u, const double &v, const double &disp);
     Vector2d projection(Vector3d P);
     Vector3d projectionNH(Vector3d P);
     Vector2d nonHomogeneous( Vector3d x);
@@ -42,6 +42,7 @@ public:
     Vector2d pl, pl_obs;
     double   disp;
     Vector3d P;
+    Matrix3d P_cov;         // covariance of the back-projection (PinholeStereoCamera::backProjectionCov)
     bool inlier;
     int rgb;
 
@@ -76,6 +77,7 @@ public:
     Vector2d spl,epl, spl_obs, epl_obs;
     double   sdisp, edisp, angle, sdisp_obs, edisp_obs;
     Vector3d sP,eP;
+    Matrix3d sP_cov, eP_cov;    // covariances of the back-projected endpoints
     Vector3d le, le_obs;
     bool inlier;
 
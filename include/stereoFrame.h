@@ -21,8 +21,6 @@
 
 #pragma once
 
-#include <future>
-#include <thread>
 #include <time.h>
 using namespace std;
 
@@ -40,6 +38,11 @@ using namespace Eigen;
 #include <stereoFeatures.h>
 #include <pinholeStereoCamera.h>
 #include <auxiliar.h>
+#include <taskScheduler.h>
+#include <featureArena.h>
+#include <descriptorIndex.h>
+#include <imagePyramid.h>
+#include <featureBudget.h>
 
 typedef Matrix<double,6,6> Matrix6d;
 typedef Matrix<double,6,1> Vector6d;
@@ -57,10 +60,21 @@ public:
 
     void extractStereoFeatures();
     void extractInitialStereoFeatures();
-    void detectFeatures(Mat img, vector<KeyPoint> &points, Mat &pdesc, vector<KeyLine> &lines, Mat &ldesc, double min_line_length);
+    void extractFeatures( bool initial );
+    void detectPointFeatures( Mat img, vector<KeyPoint> &points, Mat &pdesc );
+    void detectPointFeaturesTiled( Mat img, vector<KeyPoint> &points, Mat &pdesc );
+    void selectTileFeatures( vector<vector<KeyPoint>> &tile_points, int n_features );
+    void detectLineFeatures( const ImagePyramid &pyr, vector<KeyLine> &lines, double min_line_length );
+    int  coarseLineOctave( const ImagePyramid &pyr );
+    void refineLineFeatures( const ImagePyramid &pyr, vector<KeyLine> &lines, double min_line_length );
+    void describeLineFeatures( const ImagePyramid &pyr, vector<KeyLine> &lines, Mat &ldesc );
+    void matchStereoPoints( const vector<KeyPoint> &points_l, const vector<KeyPoint> &points_r, bool initial );
+    void epipolarCandidates( const vector<KeyPoint> &points_l, const vector<KeyPoint> &points_r, vector<vector<int>> &candidates );
+    void matchStereoLines( const vector<KeyLine> &lines_l, const vector<KeyLine> &lines_r, double min_line_length_th, bool initial );
     void matchPointFeatures(BFMatcher* bfm, Mat pdesc_1, Mat pdesc_2, vector<vector<DMatch>> &pmatches_12);
     void matchLineFeatures(Ptr<BinaryDescriptorMatcher> bdm, Mat ldesc_1, Mat ldesc_2, vector<vector<DMatch>> &lmatches_12 );
     void matchLineFeaturesBFM(BFMatcher* bfm, Mat ldesc_1, Mat ldesc_2, vector<vector<DMatch>> &lmatches_12 );
+    void matchFeaturesBidirectional(BFMatcher* bfm, Mat desc_1, Mat desc_2, vector<vector<DMatch>> &matches_12, vector<vector<DMatch>> &matches_21 );
     void pointDescriptorMAD( const vector<vector<DMatch>> matches, double &nn_mad, double &nn12_mad );
     void lineDescriptorMAD( const vector<vector<DMatch>> matches, double &nn_mad, double &nn12_mad );
     Mat  plotStereoFrame();
@@ -82,9 +96,15 @@ public:
     vector<LineFeature*>  stereo_ls;
 
     Mat pdesc_l, pdesc_r, ldesc_l, ldesc_r;
+    DescriptorIndex ldesc_index;
 
     PinholeStereoCamera* cam;
 
+    FeatureArena* arena;
+
+    FeatureBudget::Values budget;       // feature budget the frame is extracted with
+    FeatureBudget::Timing timing;       // measured time of its stages
+
 };
 
 }
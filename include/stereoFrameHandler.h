@@ -20,8 +20,13 @@
 *****************************************************************************/
 
 #pragma once
+#include <deque>
+#include <thread>
+#include <future>
 #include <stereoFrame.h>
 #include <stereoFeatures.h>
+#include <boundedQueue.h>
+#include <matchedFeatures.h>
 
 typedef Matrix<double,6,6> Matrix6d;
 typedef Matrix<double,6,1> Vector6d;
@@ -30,6 +35,34 @@ class StereoFrame;
 
 namespace StVO{
 
+// compile-time configuration of the cost function accumulated by the Gauss-Newton kernels
+template<bool RobustCost, bool ScalePointsLines>
+struct CostPolicy
+{
+    static const bool robust = RobustCost;         // Cauchy-like weighting of the residuals
+    static const bool scale  = ScalePointsLines;   // relative scaling between point and line residuals
+};
+
+// partial hessian, gradient and error accumulated over a range of matched features
+struct CostAccumulator
+{
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    CostAccumulator() : H( Matrix6d::Zero() ), g( Vector6d::Zero() ), e(0.0), N(0) {}
+    void add( const CostAccumulator &acc )
+    {
+        H += acc.H;
+        g += acc.g;
+        e += acc.e;
+        N += acc.N;
+        r.insert( r.end(), acc.r.begin(), acc.r.end() );
+    }
+    Matrix6d       H;
+    Vector6d       g;
+    double         e;
+    int            N;
+    vector<double> r;   // weighted residuals, only kept to scale points and lines
+};
+
 class StereoFrameHandler
 {
 
@@ -41,6 +74,8 @@ public:
     void initialize( const Mat img_l_, const Mat img_r_, const int idx_);
     void updateFrame();
     void insertStereoPair(const Mat img_l_, const Mat img_r_, const int idx_);
+    bool insertStereoPairPipelined(const Mat img_l_, const Mat img_r_, const int idx_);
+    bool flushStereoPair();
     void f2fTracking();
     void optimizePose();
     void optimizePose(Matrix4d DT_ini);
@@ -50,6 +85,7 @@ public:
 
     list<PointFeature*> matched_pt;
     list<LineFeature*>  matched_ls;
+    MatchedFeatures     matched;
 
     StereoFrame* prev_frame;
     StereoFrame* curr_frame;
@@ -58,12 +94,43 @@ public:
     Vector6d prior_inc;
     Matrix6d prior_cov;
 
+    FeatureBudget budget;
+    int  n_skipped_frames, n_degraded_frames;      // stereo pairs dropped by the caller, frames tracked with a single kind of feature
+
 private:
 
+    void assignBudget( StereoFrame* frame );
+    void f2fTrackingPoints();
+    void f2fTrackingLines();
+    Matrix4d predictMotion();
+    void guidedPointCandidates( const Matrix4d &T, vector<vector<int>> &candidates );
+    void guidedLineCandidates( const Matrix4d &T, vector<vector<int>> &candidates );
+    void compactMatches( vector<vector<DMatch>> &matches );
     void removeOutliers( Matrix4d DT );
-    void gaussNewtonOptimization(Matrix4d &DT, Matrix6d &DT_cov, double &err_, int max_iters);
-    void optimizeFunctions_nonweighted(Matrix4d DT, Matrix6d &H, Vector6d &g, double &e);
-    void optimizeFunctions_uncweighted(Matrix4d DT, Matrix6d &H, Vector6d &g, double &e);
+    int  updateInliers();
+    void poseOptimization(Matrix4d &DT, Matrix6d &DT_cov, double &err_, int max_iters, bool reject_outliers = false);
+    void gaussNewtonOptimization(Matrix4d &DT, Matrix6d &DT_cov, double &err_, int max_iters, bool reject_outliers);
+    void levenbergMarquardtOptimization(Matrix4d &DT, Matrix6d &DT_cov, double &err_, int max_iters, bool reject_outliers);
+    typedef void (StereoFrameHandler::*OptimizeFunctions)(const Matrix4d &DT, Matrix6d &H, Vector6d &g, double &e);
+    OptimizeFunctions selectOptimizeFunctions() const;
+    template<class P> void optimizeFunctions_nonweighted(const Matrix4d &DT, Matrix6d &H, Vector6d &g, double &e);
+    template<class P> void optimizeFunctions_uncweighted(const Matrix4d &DT, Matrix6d &H, Vector6d &g, double &e);
+    typedef void (StereoFrameHandler::*CostKernel)(const Matrix4d &DT, int i0, int i1, CostAccumulator &acc);
+    template<class P> void reduceCost(const Matrix4d &DT, CostKernel point_kernel, CostKernel line_kernel, Matrix6d &H, Vector6d &g, double &e);
+    template<class P> void pointCost_nonweighted(const Matrix4d &DT, int i0, int i1, CostAccumulator &acc);
+    template<class P> void lineCost_nonweighted(const Matrix4d &DT, int i0, int i1, CostAccumulator &acc);
+    template<class P> void pointCost_uncweighted(const Matrix4d &DT, int i0, int i1, CostAccumulator &acc);
+    template<class P> void lineCost_uncweighted(const Matrix4d &DT, int i0, int i1, CostAccumulator &acc);
+
+    int last_idx;
+
+    // pipelined execution (frames in input order, with the future of their feature extraction)
+    void startPipeline();
+    void stopPipeline();
+    void pipelineWorker();
+    deque< pair<StereoFrame*, future<void>> > pipe_frames;
+    BoundedQueue< packaged_task<void()> >*    pipe_tasks;
+    vector<thread>                            pipe_workers;
 
 };
 
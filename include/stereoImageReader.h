@@ -0,0 +1,74 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+using namespace std;
+
+#include <opencv/cv.h>
+#include <opencv2/highgui/highgui.hpp>
+using namespace cv;
+
+#include <pinholeStereoCamera.h>
+
+namespace StVO{
+
+// Background stage that decodes and rectifies the next stereo pairs of a sequence into a
+// ring of buffers, so that the tracker only waits when a pair is not ready yet. Pairs are
+// returned in the same order as the input paths, whatever the number of reader threads.
+class StereoImageReader
+{
+
+public:
+
+    StereoImageReader( const vector<string> &paths_l_, const vector<string> &paths_r_, PinholeStereoCamera* cam_, int n_buffers_, int n_threads_ );
+    ~StereoImageReader();
+
+    bool nextStereoPair( Mat &img_l, Mat &img_r );    // false once all the pairs have been returned
+
+private:
+
+    struct StereoPair
+    {
+        bool ready;
+        Mat  img_l, img_r;
+    };
+
+    void readerLoop();
+
+    vector<string>       paths_l, paths_r;
+    PinholeStereoCamera* cam;
+    vector<StereoPair>   ring;
+    int                  n_pairs;
+    int                  next_read;     // next pair to be decoded by a reader
+    int                  next_out;      // next pair to be returned to the tracker
+    bool                 stop;
+    mutex                mtx;
+    condition_variable   slot_free, slot_ready;
+    vector<thread>       readers;
+
+};
+
+}
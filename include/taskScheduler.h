@@ -0,0 +1,114 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#pragma once
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+using namespace std;
+
+namespace StVO{
+
+// Persistent pool of worker threads shared by all the frames. Every worker owns a
+// task deque: it pops its own tasks from the back and, when it runs out of work,
+// steals the oldest tasks from the front of the deques of the other workers.
+class TaskScheduler
+{
+
+public:
+
+    static TaskScheduler& getInstance();
+
+    void submit( function<void()> task );
+    bool runPendingTask();     // executes one queued task in the calling thread, if any
+    int  numWorkers() const { return workers.size(); }
+
+private:
+
+    TaskScheduler( int n_workers );
+    ~TaskScheduler();
+    TaskScheduler( const TaskScheduler& );
+    TaskScheduler& operator=( const TaskScheduler& );
+
+    struct WorkQueue
+    {
+        mutex                     mtx;
+        deque< function<void()> > tasks;
+    };
+
+    void workerLoop( int idx );
+    bool popTask( int idx, function<void()> &task );
+
+    vector< unique_ptr<WorkQueue> > queues;
+    vector<thread>                  workers;
+    atomic<int>                     n_pending;
+    atomic<unsigned int>            next_queue;
+    bool                            stop;
+    mutex                           wake_mtx;
+    condition_variable              wake_cv;
+
+};
+
+// Dependency graph of the tasks of one frame: a task is submitted to the scheduler
+// as soon as all the tasks it depends on have finished. Tasks must be added after
+// their dependencies, so that the insertion order is also a valid serial order.
+class TaskGraph
+{
+
+public:
+
+    typedef int TaskId;
+
+    TaskGraph();
+    ~TaskGraph();
+
+    TaskId addTask( function<void()> fn, const vector<TaskId> &deps = vector<TaskId>() );
+    void   run( bool parallel = true );    // blocks until all the tasks have finished
+
+    // threads each of n_tasks tasks run together may use for its own parallel loops
+    static int threadShare( int n_tasks, bool parallel = true );
+
+private:
+
+    struct Node
+    {
+        function<void()> fn;
+        vector<TaskId>   successors;
+        int              n_deps;
+        atomic<int>      n_waiting;
+    };
+
+    void launch( TaskId id );
+    void execute( TaskId id );
+
+    vector< unique_ptr<Node> > nodes;
+    atomic<int>                n_remaining;
+    mutex                      done_mtx;
+    condition_variable         done_cv;
+
+};
+
+}
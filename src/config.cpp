@@ -39,6 +39,14 @@ Config::Config()
     scale_points_lines = false;     // true if scaling the influence of P and LS in the optimization
     use_uncertainty    = false;     // true if employing Gaussian uncertainty propagation
     motion_prior       = false;     // true if optimizing with prior information about the motion (i.e. IMU)
+    use_pipeline       = false;     // true if extracting features of the next frames while tracking the current one
+    use_simd_matcher   = true;      // true if matching 256-bit binary descriptors with the vectorized Hamming matcher
+    stereo_band_match  = false;     // true if matching stereo points only inside their epipolar band and disparity range
+    guided_f2f         = false;     // true if matching f2f features only around their position predicted by the motion model
+    budget_control     = false;     // true if adapting the feature budget of each frame to hold a target frame time
+    real_time          = false;     // true if dropping stale stereo pairs and tracking a single kind of feature after a missed deadline
+    use_lev_marquardt  = false;     // true if estimating the pose with Levenberg-Marquardt instead of Gauss-Newton
+    irls_outliers      = false;     // true if rejecting outliers inside the iterations of a single optimization pass
 
     // Tracking parameters
     // -----------------------------------------------------------------------------------------------------
@@ -47,6 +55,7 @@ Config::Config()
     min_disp         = 1.0;         // min. disparity
     min_ratio_12_p   = 0.1;         // min. ratio between the first and second best matches
     max_f2f_disp     = 0.2;         // max. frame-to-frame disparity (relative to img size)
+    f2f_guided_win   = 30.0;        // half-size of the search window around the predicted position (pixels, if guided_f2f)
     // Line segment features
     min_line_length  = 0.025;       // min. line length (relative to img size)
     min_horiz_angle  = 10.0;        // min. angle to avoid horizontal lines
@@ -67,17 +76,42 @@ Config::Config()
     max_iters_ref    = 10;          // max. number of iterations in the refinement stage
     min_error        = 0.0000001;   // min. error to stop the optimization
     min_error_change = 0.0000001;   // min. error change to stop the optimization
-    inlier_k         = 1.5;         // factor to discard outliers before the refinement stage
+    min_grad_norm    = 0.0000001;   // min. gradient norm to stop the optimization (if use_lev_marquardt)
+    min_rel_step     = 0.000001;    // min. step relative to the pose to stop the optimization (if use_lev_marquardt)
+    inlier_k         = 1.5;         // factor to discard outliers before the refinement stage (or at each iteration if irls_outliers)
     sigma_px         = 1.0;         // expected standard deviation of features (if use_uncertainty)
     max_optim_error  = 10.0;        // max. optimization error to consider a solution as good (disabled)
     max_cov_eigval   = 0.01;        //
 
+    // Multi-threading parameters
+    // -----------------------------------------------------------------------------------------------------
+    pipeline_depth   = 3;           // max. number of frames in flight when pipelined (backpressure); the adaptive budget lags as many frames
+    pipeline_workers = 2;           // number of threads extracting features when pipelined
+    num_threads      = thread::hardware_concurrency();  // number of workers of the per-frame task scheduler
+    prefetch_pairs   = 4;           // number of stereo pairs decoded and rectified ahead of the tracker
+    prefetch_threads = 2;           // number of threads decoding the images
+
+    // Feature budget control parameters (if budget_control)
+    // -----------------------------------------------------------------------------------------------------
+    budget_target_ms = 33.0;        // target frame time (ms), sum of extraction, tracking and optimization
+    budget_gain      = 0.5;         // exponent of the correction (target / measured time) applied every frame
+    budget_min_scale = 0.25;        // min. scale of the nominal budget (orb_nfeatures, min_line_length, lsd_scale)
+    budget_max_scale = 1.5;         // max. scale of the nominal budget
+    budget_inlier_margin = 2.0;     // the budget is not reduced while inliers < margin * min_features
+
+    // Real-time parameters (if real_time)
+    // -----------------------------------------------------------------------------------------------------
+    rt_deadline_ms     = 66.0;      // per-frame deadline (ms), sum of extraction, tracking and optimization
+    rt_degraded_frames = 5;         // number of frames tracked with points or lines only after a missed deadline
+
     // Feature detection parameters
     // -----------------------------------------------------------------------------------------------------
     // ORB detector
     orb_nfeatures    = 1200;
     orb_scale_factor = 1.2;
     orb_nlevels      = 1;
+    orb_grid_cols    = 1;           // the image is split in a grid of tiles detected in parallel (1x1 disables it)
+    orb_grid_rows    = 1;
     // LSD parameters
     lsd_refine       = 2;
     lsd_scale        = 1.2;
@@ -87,6 +121,13 @@ Config::Config()
     lsd_log_eps      = 1.0;
     lsd_density_th   = 0.6;
     lsd_n_bins       = 1024;
+    lsd_grid_cols    = 1;           // the image is split in a grid of overlapping tiles detected in parallel (1x1 disables it)
+    lsd_grid_rows    = 1;
+    lsd_tile_overlap = 16;          // overlap between neighbouring tiles (px)
+    lsd_merge_ang_th = 3.0;         // max. angle difference to merge the pieces of a segment split by a seam (deg)
+    lsd_merge_dist_th= 2.0;         // max. distance between the pieces of a segment split by a seam (px)
+    lsd_coarse_octave= 0;           // octave where LSD runs before refining the segments at full resolution (0 = full res., 1 = half, 2 = quarter)
+    lsd_coarse_band  = 1.5;         // half-width of the band around each upscaled segment searched when refining it (coarse px)
 
     // BRISK detector (too slow)
     brs_threshold    = 50;
@@ -0,0 +1,58 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#include <descriptorIndex.h>
+
+namespace StVO{
+
+DescriptorIndex::DescriptorIndex() : n_desc(0) {}
+
+DescriptorIndex::~DescriptorIndex(){}
+
+void DescriptorIndex::build( const Mat &desc )
+{
+    unique_lock<mutex> lock( mtx );
+    bdm = BinaryDescriptorMatcher::createBinaryDescriptorMatcher();
+    n_desc = desc.rows;
+    if( n_desc == 0 )
+        return;
+    bdm->add( vector<Mat>( 1, desc ) );
+    bdm->train();
+}
+
+void DescriptorIndex::clear()
+{
+    unique_lock<mutex> lock( mtx );
+    bdm = Ptr<BinaryDescriptorMatcher>();
+    n_desc = 0;
+}
+
+void DescriptorIndex::knnMatch( const Mat &query, vector<vector<DMatch>> &matches, int k, int max_threads )
+{
+    matches.clear();
+    unique_lock<mutex> lock( mtx );
+    if( n_desc == 0 || query.rows == 0 )
+        return;
+    bdm->setMaxThreads( max_threads );
+    bdm->knnMatch( query, matches, k );
+}
+
+}
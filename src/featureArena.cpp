@@ -0,0 +1,97 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#include <featureArena.h>
+
+namespace StVO{
+
+// arenas released by the retired frames, waiting to be reused
+struct ArenaPool
+{
+    mutex                 mtx;
+    vector<FeatureArena*> arenas;
+    ~ArenaPool()
+    {
+        for( size_t i = 0; i < arenas.size(); i++ )
+            delete arenas[i];
+    }
+};
+static ArenaPool pool;
+
+FeatureArena::FeatureArena( size_t block_size_ ) : block_size(block_size_), curr_block(0), offset(0) {}
+
+FeatureArena::~FeatureArena()
+{
+    for( size_t i = 0; i < blocks.size(); i++ )
+        delete [] blocks[i];
+}
+
+FeatureArena* FeatureArena::acquire()
+{
+    lock_guard<mutex> lock(pool.mtx);
+    if( pool.arenas.empty() )
+        return new FeatureArena();
+    FeatureArena* arena = pool.arenas.back();
+    pool.arenas.pop_back();
+    return arena;
+}
+
+void FeatureArena::recycle( FeatureArena* arena )
+{
+    if( arena == NULL )
+        return;
+    arena->reset();
+    lock_guard<mutex> lock(pool.mtx);
+    pool.arenas.push_back( arena );
+}
+
+void* FeatureArena::allocate( size_t size )
+{
+    lock_guard<mutex> lock(mtx);
+    while( true )
+    {
+        // new blocks are over-allocated by the alignment, so that the object fits in them
+        if( curr_block == blocks.size() )
+        {
+            capacities.push_back( max( block_size, size ) + alignment );
+            blocks.push_back( new char[ capacities.back() ] );
+            offset = 0;
+        }
+        uintptr_t base = reinterpret_cast<uintptr_t>( blocks[curr_block] );
+        uintptr_t ptr  = ( base + offset + alignment - 1 ) & ~uintptr_t( alignment - 1 );
+        if( ptr + size <= base + capacities[curr_block] )
+        {
+            offset = ptr + size - base;
+            return reinterpret_cast<void*>( ptr );
+        }
+        curr_block++;
+        offset = 0;
+    }
+}
+
+void FeatureArena::reset()
+{
+    lock_guard<mutex> lock(mtx);
+    curr_block = 0;
+    offset     = 0;
+}
+
+}
@@ -0,0 +1,101 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#include <featureBudget.h>
+#include <algorithm>
+
+namespace StVO{
+
+FeatureBudget::FeatureBudget() : scale(1.0), values( nominal() ), degraded_left(0), degraded_points(true) {}
+
+FeatureBudget::~FeatureBudget(){}
+
+FeatureBudget::Values FeatureBudget::nominal()
+{
+    return scaled( 1.0 );
+}
+
+double FeatureBudget::elapsedMs( const Clock::time_point &t0 )
+{
+    return chrono::duration<double,milli>( Clock::now() - t0 ).count();
+}
+
+FeatureBudget::Values FeatureBudget::scaled( double scale )
+{
+    // the number of points follows the scale, the cost of LSD goes with the square of its scale
+    // (never above the nominal one) and the number of lines with the inverse of the min. length
+    Values v;
+    v.points          = true;
+    v.lines           = true;
+    v.orb_nfeatures   = std::max( 1, int( round( scale * Config::orbNFeatures() ) ) );
+    v.min_line_length = Config::minLineLength() / sqrt( scale );
+    v.lsd_scale       = Config::lsdScale() * std::min( 1.0, sqrt( scale ) );
+    return v;
+}
+
+void FeatureBudget::update( const Timing &timing, int n_inliers_pt, int n_inliers_ls )
+{
+
+    if( timing.total() <= 0.0 )
+        return;
+    int n_inliers = n_inliers_pt + n_inliers_ls;
+
+    if( Config::budgetControl() )
+    {
+        // multiplicative correction towards the target time (damped by the gain)
+        double correction = pow( Config::budgetTargetMs() / timing.total(), Config::budgetGain() );
+
+        // do not starve the optimizer: hold the budget near the min. number of features, grow it below
+        if( n_inliers < Config::minFeatures() )
+            correction = std::max( correction, 1.25 );
+        else if( n_inliers < Config::budgetInlierMargin() * Config::minFeatures() )
+            correction = std::max( correction, 1.0 );
+
+        scale  = std::min( std::max( scale * correction, Config::budgetMinScale() ), Config::budgetMaxScale() );
+        values = scaled( scale );
+    }
+    else
+        values = nominal();
+
+    if( Config::realTime() && Config::hasPoints() && Config::hasLines() )
+    {
+        // a missed deadline degrades the next frames to the kind of feature with more inliers (for
+        // as long as the deadline keeps being missed), unless that kind alone starves the optimizer
+        if( degraded_left > 0 )
+            degraded_left--;
+        if( timing.total() > Config::rtDeadlineMs() )
+        {
+            if( degraded_left == 0 )
+                degraded_points = ( n_inliers_pt >= n_inliers_ls );
+            degraded_left = Config::rtDegradedFrames();
+        }
+        if( ( degraded_points ? n_inliers_pt : n_inliers_ls ) < Config::minFeatures() )
+            degraded_left = 0;
+        if( degraded_left > 0 )
+        {
+            values.points = degraded_points;
+            values.lines  = !degraded_points;
+        }
+    }
+
+}
+
+}
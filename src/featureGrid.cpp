@@ -0,0 +1,76 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#include <featureGrid.h>
+#include <algorithm>
+#include <cmath>
+
+namespace StVO{
+
+FeatureGrid::FeatureGrid( int width, int height, double cell_size_ ) : cell_size( max(cell_size_,1.0) )
+{
+    n_cols = max( 1, int(ceil( width  / cell_size )) );
+    n_rows = max( 1, int(ceil( height / cell_size )) );
+    cells.resize( n_cols * n_rows );
+}
+
+FeatureGrid::~FeatureGrid(){}
+
+void FeatureGrid::insert( int idx, const Vector2d &x )
+{
+    // features outside the image are stored in the border cells
+    int c = min( max( int(floor( x(0) / cell_size )), 0 ), n_cols-1 );
+    int r = min( max( int(floor( x(1) / cell_size )), 0 ), n_rows-1 );
+    cells[ r * n_cols + c ].push_back( idx );
+    if( idx >= pos_x.size() )
+    {
+        pos_x.resize( idx+1 );
+        pos_y.resize( idx+1 );
+    }
+    pos_x[idx] = x(0);
+    pos_y[idx] = x(1);
+}
+
+void FeatureGrid::query( const Vector2d &x, double radius, vector<int> &indices ) const
+{
+    indices.clear();
+    // (clamped as in insert, so that the features outside the image are also found)
+    int c0 = min( max( int(floor( (x(0) - radius) / cell_size )), 0 ), n_cols-1 );
+    int c1 = min( max( int(floor( (x(0) + radius) / cell_size )), 0 ), n_cols-1 );
+    int r0 = min( max( int(floor( (x(1) - radius) / cell_size )), 0 ), n_rows-1 );
+    int r1 = min( max( int(floor( (x(1) + radius) / cell_size )), 0 ), n_rows-1 );
+    for( int r = r0; r <= r1; r++ )
+    {
+        for( int c = c0; c <= c1; c++ )
+        {
+            const vector<int> &cell = cells[ r * n_cols + c ];
+            for( int k = 0; k < cell.size(); k++ )
+            {
+                int idx = cell[k];
+                if( fabs( pos_x[idx] - x(0) ) <= radius && fabs( pos_y[idx] - x(1) ) <= radius )
+                    indices.push_back( idx );
+            }
+        }
+    }
+    sort( indices.begin(), indices.end() );
+}
+
+}
@@ -0,0 +1,296 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#include <hammingMatcher.h>
+#include <taskScheduler.h>
+#include <config.h>
+#include <climits>
+#include <cstring>
+#include <stdint.h>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace StVO{
+
+static const int DESC_WORDS   = 4;     // 64-bit words per descriptor
+static const int BLOCK_SIZE   = 8;     // train descriptors interleaved in a block
+static const int CHUNK_BLOCKS = 64;    // train blocks processed per chunk (64 x 256 bytes)
+static const int MIN_RANGE    = 64;    // min. number of queries per parallel task
+
+// interleave the train descriptors: word w of the descriptors 8b..8b+7 is stored contiguously at
+// packed[ (b*4 + w) * 8 ], and the last block is padded with zeros
+static void packDescriptors( const Mat &desc, vector<uint64_t> &packed )
+{
+    int n_blocks = ( desc.rows + BLOCK_SIZE - 1 ) / BLOCK_SIZE;
+    packed.assign( n_blocks * DESC_WORDS * BLOCK_SIZE, 0 );
+    for( int j = 0; j < desc.rows; j++ )
+    {
+        uint64_t words[DESC_WORDS];
+        memcpy( words, desc.ptr<uchar>(j), sizeof(words) );
+        uint64_t* block = &packed[ (j / BLOCK_SIZE) * DESC_WORDS * BLOCK_SIZE ];
+        for( int w = 0; w < DESC_WORDS; w++ )
+            block[ w * BLOCK_SIZE + j % BLOCK_SIZE ] = words[w];
+    }
+}
+
+// distances from a query descriptor to the 8 descriptors of a block
+static inline void blockDistances( const uint64_t* q, const uint64_t* block, int* dist )
+{
+#if defined(__AVX512F__) && defined(__AVX512VPOPCNTDQ__)
+    __m512i acc = _mm512_setzero_si512();
+    for( int w = 0; w < DESC_WORDS; w++ )
+    {
+        __m512i x = _mm512_xor_si512( _mm512_set1_epi64( q[w] ), _mm512_loadu_si512( block + w * BLOCK_SIZE ) );
+        acc = _mm512_add_epi64( acc, _mm512_popcnt_epi64( x ) );
+    }
+    _mm256_storeu_si256( (__m256i*) dist, _mm512_cvtepi64_epi32( acc ) );
+#elif defined(__AVX2__)
+    const __m256i lut  = _mm256_setr_epi8( 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4, 0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4 );
+    const __m256i low4 = _mm256_set1_epi8( 0x0f );
+    const __m256i zero = _mm256_setzero_si256();
+    for( int h = 0; h < BLOCK_SIZE; h += 4 )
+    {
+        // per-byte counts of the 4 words (at most 32, no overflow) and sum of the bytes of each 64-bit lane
+        __m256i cnt = zero;
+        for( int w = 0; w < DESC_WORDS; w++ )
+        {
+            __m256i x = _mm256_xor_si256( _mm256_set1_epi64x( q[w] ), _mm256_loadu_si256( (const __m256i*) ( block + w * BLOCK_SIZE + h ) ) );
+            __m256i lo = _mm256_shuffle_epi8( lut, _mm256_and_si256( x, low4 ) );
+            __m256i hi = _mm256_shuffle_epi8( lut, _mm256_and_si256( _mm256_srli_epi16( x, 4 ), low4 ) );
+            cnt = _mm256_add_epi8( cnt, _mm256_add_epi8( lo, hi ) );
+        }
+        int64_t sums[4];
+        _mm256_storeu_si256( (__m256i*) sums, _mm256_sad_epu8( cnt, zero ) );
+        for( int l = 0; l < 4; l++ )
+            dist[h+l] = sums[l];
+    }
+#else
+    for( int l = 0; l < BLOCK_SIZE; l++ )
+    {
+        dist[l] = 0;
+        for( int w = 0; w < DESC_WORDS; w++ )
+            dist[l] += __builtin_popcountll( q[w] ^ block[ w * BLOCK_SIZE + l ] );
+    }
+#endif
+}
+
+// insert a candidate in a list of k distances sorted in ascending order, keeping the earlier
+// candidate on ties (the first index wins, as in BFMatcher)
+static inline void insertKnn( int* knn_dist, int* knn_idx, int k, int dist, int idx )
+{
+    if( dist >= knn_dist[k-1] )
+        return;
+    int r = k - 1;
+    for( ; r > 0 && dist < knn_dist[r-1]; r-- )
+    {
+        knn_dist[r] = knn_dist[r-1];
+        knn_idx[r]  = knn_idx[r-1];
+    }
+    knn_dist[r] = dist;
+    knn_idx[r]  = idx;
+}
+
+// Hamming distance between two descriptors of any length
+static inline int descriptorDistance( const uchar* d1, const uchar* d2, int n_bytes )
+{
+    int dist = 0, b = 0;
+    for( ; b + 8 <= n_bytes; b += 8 )
+    {
+        uint64_t w1, w2;
+        memcpy( &w1, d1 + b, 8 );
+        memcpy( &w2, d2 + b, 8 );
+        dist += __builtin_popcountll( w1 ^ w2 );
+    }
+    for( ; b < n_bytes; b++ )
+        dist += __builtin_popcount( d1[b] ^ d2[b] );
+    return dist;
+}
+
+// same layout as BFMatcher::knnMatch
+static void knnToMatches( const vector<int> &knn_dist, const vector<int> &knn_idx, int n, int k, vector<vector<DMatch>> &matches )
+{
+    matches.resize( n );
+    for( int i = 0; i < n; i++ )
+    {
+        for( int r = 0; r < k && knn_idx[i*k+r] >= 0; r++ )
+            matches[i].push_back( DMatch( i, knn_idx[i*k+r], 0, float(knn_dist[i*k+r]) ) );
+    }
+}
+
+// scans the queries [i0,i1) against all the packed train descriptors, updating the k best train
+// descriptors of each query and, if col_dist is not null, the k best queries of each train descriptor
+static void scanQueries( const vector<uint64_t> &query_words, int i0, int i1, const vector<uint64_t> &packed, int n_train, int k,
+                         int* row_dist, int* row_idx, int* col_dist, int* col_idx )
+{
+    int n_blocks = ( n_train + BLOCK_SIZE - 1 ) / BLOCK_SIZE;
+    for( int b0 = 0; b0 < n_blocks; b0 += CHUNK_BLOCKS )
+    {
+        int b1 = min( n_blocks, b0 + CHUNK_BLOCKS );
+        for( int i = i0; i < i1; i++ )
+        {
+            for( int b = b0; b < b1; b++ )
+            {
+                int dist[BLOCK_SIZE];
+                blockDistances( &query_words[i*DESC_WORDS], &packed[ b * DESC_WORDS * BLOCK_SIZE ], dist );
+                int n_valid = min( BLOCK_SIZE, n_train - b * BLOCK_SIZE );
+                for( int l = 0; l < n_valid; l++ )
+                {
+                    int j = b * BLOCK_SIZE + l;
+                    insertKnn( &row_dist[i*k], &row_idx[i*k], k, dist[l], j );
+                    if( col_dist != NULL )
+                        insertKnn( &col_dist[j*k], &col_idx[j*k], k, dist[l], i );
+                }
+            }
+        }
+    }
+}
+
+bool HammingMatcher::isSupported( const Mat &desc )
+{
+    return desc.depth() == CV_8U && desc.cols * desc.channels() == DESC_WORDS * 8;
+}
+
+void HammingMatcher::knnMatch( const Mat &query, const Mat &train, vector<vector<DMatch>> &matches, int k )
+{
+
+    matches.clear();
+    if( query.empty() || train.empty() || k <= 0 )
+        return;
+
+    // queries as 64-bit words and interleaved train descriptors
+    int n_query  = query.rows;
+    int n_train  = train.rows;
+    vector<uint64_t> query_words( n_query * DESC_WORDS ), packed;
+    for( int i = 0; i < n_query; i++ )
+        memcpy( &query_words[i*DESC_WORDS], query.ptr<uchar>(i), DESC_WORDS * sizeof(uint64_t) );
+    packDescriptors( train, packed );
+
+    vector<int> knn_dist( n_query * k, INT_MAX ), knn_idx( n_query * k, -1 );
+    scanQueries( query_words, 0, n_query, packed, n_train, k, &knn_dist[0], &knn_idx[0], NULL, NULL );
+    knnToMatches( knn_dist, knn_idx, n_query, k, matches );
+
+}
+
+void HammingMatcher::knnMatchBidirectional( const Mat &desc_1, const Mat &desc_2, vector<vector<DMatch>> &matches_12,
+                                            vector<vector<DMatch>> &matches_21, int k, bool parallel )
+{
+
+    matches_12.clear();
+    matches_21.clear();
+    if( desc_1.empty() || desc_2.empty() || k <= 0 )
+        return;
+
+    int n_1 = desc_1.rows;
+    int n_2 = desc_2.rows;
+    vector<int> dist_12( n_1 * k, INT_MAX ), idx_12( n_1 * k, -1 );
+    vector<int> dist_21( n_2 * k, INT_MAX ), idx_21( n_2 * k, -1 );
+
+    if( !isSupported(desc_1) || !isSupported(desc_2) )
+    {
+        // generic descriptors (e.g. BRISK): full distance matrix computed once by OpenCV
+        Mat dist;
+        batchDistance( desc_1, desc_2, dist, CV_32S, noArray(), NORM_HAMMING );
+        for( int i = 0; i < n_1; i++ )
+        {
+            const int* dist_i = dist.ptr<int>(i);
+            for( int j = 0; j < n_2; j++ )
+            {
+                insertKnn( &dist_12[i*k], &idx_12[i*k], k, dist_i[j], j );
+                insertKnn( &dist_21[j*k], &idx_21[j*k], k, dist_i[j], i );
+            }
+        }
+    }
+    else
+    {
+        vector<uint64_t> query_words( n_1 * DESC_WORDS ), packed;
+        for( int i = 0; i < n_1; i++ )
+            memcpy( &query_words[i*DESC_WORDS], desc_1.ptr<uchar>(i), DESC_WORDS * sizeof(uint64_t) );
+        packDescriptors( desc_2, packed );
+
+        // the queries are split in contiguous ranges, each with its own column lists, which are
+        // merged in range order so that ties are resolved exactly as in a serial scan
+        int n_ranges = parallel ? max( 1, min( Config::numThreads(), n_1 / MIN_RANGE ) ) : 1;
+        if( n_ranges == 1 )
+            scanQueries( query_words, 0, n_1, packed, n_2, k, &dist_12[0], &idx_12[0], &dist_21[0], &idx_21[0] );
+        else
+        {
+            vector<vector<int>> range_dist( n_ranges, vector<int>( n_2 * k, INT_MAX ) );
+            vector<vector<int>> range_idx( n_ranges, vector<int>( n_2 * k, -1 ) );
+            TaskGraph graph;
+            for( int r = 0; r < n_ranges; r++ )
+            {
+                int i0 = ( n_1 * r ) / n_ranges;
+                int i1 = ( n_1 * (r+1) ) / n_ranges;
+                graph.addTask( [&,r,i0,i1]{ scanQueries( query_words, i0, i1, packed, n_2, k, &dist_12[0], &idx_12[0],
+                                                         &range_dist[r][0], &range_idx[r][0] ); } );
+            }
+            graph.run( true );
+            dist_21.swap( range_dist[0] );
+            idx_21.swap( range_idx[0] );
+            for( int r = 1; r < n_ranges; r++ )
+            {
+                for( int j = 0; j < n_2 * k; j++ )
+                {
+                    if( range_idx[r][j] >= 0 )
+                        insertKnn( &dist_21[(j/k)*k], &idx_21[(j/k)*k], k, range_dist[r][j], range_idx[r][j] );
+                }
+            }
+        }
+    }
+
+    knnToMatches( dist_12, idx_12, n_1, k, matches_12 );
+    knnToMatches( dist_21, idx_21, n_2, k, matches_21 );
+
+}
+
+void HammingMatcher::knnMatchCandidates( const Mat &desc_1, const Mat &desc_2, const vector<vector<int>> &candidates,
+                                         vector<vector<DMatch>> &matches_12, vector<vector<DMatch>> &matches_21, int k )
+{
+
+    matches_12.clear();
+    matches_21.clear();
+    if( desc_1.empty() || desc_2.empty() || k <= 0 )
+        return;
+
+    int n_1 = desc_1.rows;
+    int n_2 = desc_2.rows;
+    int n_bytes = desc_1.cols * desc_1.channels();
+    vector<int> dist_12( n_1 * k, INT_MAX ), idx_12( n_1 * k, -1 );
+    vector<int> dist_21( n_2 * k, INT_MAX ), idx_21( n_2 * k, -1 );
+    for( int i = 0; i < n_1; i++ )
+    {
+        const uchar* d1 = desc_1.ptr<uchar>(i);
+        for( size_t c = 0; c < candidates[i].size(); c++ )
+        {
+            int j    = candidates[i][c];
+            int dist = descriptorDistance( d1, desc_2.ptr<uchar>(j), n_bytes );
+            insertKnn( &dist_12[i*k], &idx_12[i*k], k, dist, j );
+            insertKnn( &dist_21[j*k], &idx_21[j*k], k, dist, i );
+        }
+    }
+
+    knnToMatches( dist_12, idx_12, n_1, k, matches_12 );
+    knnToMatches( dist_21, idx_21, n_2, k, matches_21 );
+
+}
+
+}
@@ -0,0 +1,88 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#include <imagePyramid.h>
+
+namespace StVO{
+
+ImagePyramid::ImagePyramid() : ratio(2) {}
+
+ImagePyramid::ImagePyramid( const Mat &img, int n_octaves, int ratio_ )
+{
+    compute( img, n_octaves, ratio_ );
+}
+
+ImagePyramid::~ImagePyramid(){}
+
+void ImagePyramid::compute( const Mat &img, int n_octaves, int ratio_ )
+{
+    ratio = ratio_;
+    octaves.clear();
+    smoothed.clear();
+    dx.clear();
+    dy.clear();
+
+    // the input image is shared, not copied
+    Mat gray;
+    if( img.channels() != 1 )
+        cvtColor( img, gray, COLOR_BGR2GRAY );
+    else
+        gray = img;
+    octaves.push_back( gray );
+
+    for( int i = 1; i < n_octaves; i++ )
+    {
+        Mat down;
+        pyrDown( octaves.back(), down, Size( octaves.back().cols / ratio, octaves.back().rows / ratio ) );
+        octaves.push_back( down );
+    }
+}
+
+void ImagePyramid::computeGradients()
+{
+    smoothed.clear();
+    dx.clear();
+    dy.clear();
+    if( octaves.empty() )
+        return;
+
+    // same smoothing and derivatives as BinaryDescriptor::computeSobel
+    Mat blurred;
+    GaussianBlur( octaves[0], blurred, Size( 5, 5 ), 1 );
+    smoothed.push_back( blurred );
+    for( int i = 1; i < size(); i++ )
+    {
+        Mat down;
+        pyrDown( smoothed.back(), down, Size( smoothed.back().cols / ratio, smoothed.back().rows / ratio ) );
+        smoothed.push_back( down );
+    }
+
+    for( int i = 0; i < size(); i++ )
+    {
+        Mat dx_, dy_;
+        Sobel( smoothed[i], dx_, CV_16SC1, 1, 0, 3 );
+        Sobel( smoothed[i], dy_, CV_16SC1, 0, 1, 3 );
+        dx.push_back( dx_ );
+        dy.push_back( dy_ );
+    }
+}
+
+}
@@ -0,0 +1,99 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#include <matchedFeatures.h>
+
+namespace StVO{
+
+MatchedFeatures::MatchedFeatures(){}
+
+MatchedFeatures::~MatchedFeatures(){}
+
+void MatchedFeatures::clear()
+{
+    pt_X.clear();     pt_Y.clear();     pt_Z.clear();
+    pt_cov.clear();
+    pt_u_obs.clear(); pt_v_obs.clear();
+    pt_res.clear();
+    pt_inlier.clear();
+    pt_src.clear();
+
+    ls_sX.clear();    ls_sY.clear();    ls_sZ.clear();
+    ls_eX.clear();    ls_eY.clear();    ls_eZ.clear();
+    ls_scov.clear();  ls_ecov.clear();
+    ls_lx.clear();    ls_ly.clear();    ls_lz.clear();
+    ls_res.clear();
+    ls_inlier.clear();
+    ls_src.clear();
+}
+
+void MatchedFeatures::assign( const list<PointFeature*> &matched_pt, const list<LineFeature*> &matched_ls )
+{
+
+    // the arrays keep their capacity between frames
+    clear();
+
+    // point features
+    for( list<PointFeature*>::const_iterator it = matched_pt.begin(); it != matched_pt.end(); it++ )
+    {
+        const PointFeature* pt = *it;
+        pt_X.push_back( pt->P(0) );
+        pt_Y.push_back( pt->P(1) );
+        pt_Z.push_back( pt->P(2) );
+        pt_cov.push_back( pt->P_cov );
+        pt_u_obs.push_back( pt->pl_obs(0) );
+        pt_v_obs.push_back( pt->pl_obs(1) );
+        pt_res.push_back( 0.0 );
+        pt_inlier.push_back( pt->inlier );
+        pt_src.push_back( *it );
+    }
+
+    // line segment features
+    for( list<LineFeature*>::const_iterator it = matched_ls.begin(); it != matched_ls.end(); it++ )
+    {
+        const LineFeature* ls = *it;
+        ls_sX.push_back( ls->sP(0) );
+        ls_sY.push_back( ls->sP(1) );
+        ls_sZ.push_back( ls->sP(2) );
+        ls_eX.push_back( ls->eP(0) );
+        ls_eY.push_back( ls->eP(1) );
+        ls_eZ.push_back( ls->eP(2) );
+        ls_scov.push_back( ls->sP_cov );
+        ls_ecov.push_back( ls->eP_cov );
+        ls_lx.push_back( ls->le_obs(0) );
+        ls_ly.push_back( ls->le_obs(1) );
+        ls_lz.push_back( ls->le_obs(2) );
+        ls_res.push_back( 0.0 );
+        ls_inlier.push_back( ls->inlier );
+        ls_src.push_back( *it );
+    }
+
+}
+
+void MatchedFeatures::writeInliers()
+{
+    for( int i = 0; i < pt_src.size(); i++ )
+        pt_src[i]->inlier = pt_inlier[i];
+    for( int i = 0; i < ls_src.size(); i++ )
+        ls_src[i]->inlier = ls_inlier[i];
+}
+
+}
@@ -113,6 +113,25 @@ Vector3d PinholeStereoCamera::backProjection( const double &u, const double &v,
     return P;
 }
 
+// Analytical covariance of the back-projected point, up to the scale b^2 * sigma_px^2 of the stereo noise
+Matrix3d PinholeStereoCamera::backProjectionCov( const double &u, const double &v, const double &disp )
+{
+    double px_hat = u - cx;
+    double py_hat = v - cy;
+    double disp2  = disp * disp;
+    Matrix3d covP_an;
+    covP_an(0,0) = disp2+2.f*px_hat*px_hat;
+    covP_an(0,1) = 2.f*px_hat*py_hat;
+    covP_an(0,2) = 2.f*fx*px_hat;
+    covP_an(1,1) = disp2+2.f*py_hat*py_hat;
+    covP_an(1,2) = 2.f*fx*py_hat;
+    covP_an(2,2) = 2.f*fx*fx;
+    covP_an(1,0) = covP_an(0,1);
+    covP_an(2,0) = covP_an(0,2);
+    covP_an(2,1) = covP_an(1,2);
+    return covP_an / (disp2*disp2);
+}
+
 Vector2d PinholeStereoCamera::projection( Vector3d P )
 {
     Vector2d uv_unit;
@@ -20,577 +20,710 @@
 *****************************************************************************/
 
 #include <stereoFrame.h>
+#include <hammingMatcher.h>
 
 namespace StVO{
 
-StereoFrame::StereoFrame(){}
+StereoFrame::StereoFrame() : arena( FeatureArena::acquire() ), budget( FeatureBudget::nominal() ) {}
 
 StereoFrame::StereoFrame(const Mat img_l_, const Mat img_r_ , const int idx_, PinholeStereoCamera *cam_) :
-    img_l(img_l_), img_r(img_r_), frame_idx(idx_), cam(cam_) {}
+    img_l(img_l_), img_r(img_r_), frame_idx(idx_), cam(cam_), arena( FeatureArena::acquire() ), budget( FeatureBudget::nominal() ) {}
 
 StereoFrame::StereoFrame(const Mat img_l_, const Mat img_r_ , const Mat img_s_, const int idx_, PinholeStereoCamera *cam_) :
-    img_l(img_l_), img_r(img_r_), img_s(img_s_), frame_idx(idx_), cam(cam_) {}
+    img_l(img_l_), img_r(img_r_), img_s(img_s_), frame_idx(idx_), cam(cam_), arena( FeatureArena::acquire() ), budget( FeatureBudget::nominal() ) {}
 
-StereoFrame::~StereoFrame(){}
+StereoFrame::~StereoFrame()
+{
+    // the features live in the arena of the frame, which is rewound and reused by the next frames
+    stereo_pt.clear();
+    stereo_ls.clear();
+    FeatureArena::recycle( arena );
+}
 
 void StereoFrame::extractInitialStereoFeatures()
+{
+    extractFeatures( true );
+}
+
+void StereoFrame::extractStereoFeatures()
+{
+    extractFeatures( false );
+}
+
+void StereoFrame::extractFeatures( bool initial )
 {
 
-    // Feature detection and description
+    // Feature detection and description (task graph: ORB, LSD and LBD of each image, then stereo matching)
+    FeatureBudget::Clock::time_point t0 = FeatureBudget::Clock::now();
     vector<KeyPoint> points_l, points_r;
     vector<KeyLine>  lines_l, lines_r;
-    double min_line_length_th = Config::minLineLength() * std::min( cam->getWidth(), cam->getHeight() );
-    if( Config::lrInParallel() )
+    double min_line_length_th = budget.min_line_length * std::min( cam->getWidth(), cam->getHeight() );
+    TaskGraph graph;
+
+    // Points detection and stereo matching
+    if( Config::hasPoints() && budget.points )
     {
-        auto detect_l = async(launch::async, &StereoFrame::detectFeatures, this, img_l, ref(points_l), ref(pdesc_l), ref(lines_l), ref(ldesc_l), min_line_length_th );
-        auto detect_r = async(launch::async, &StereoFrame::detectFeatures, this, img_r, ref(points_r), ref(pdesc_r), ref(lines_r), ref(ldesc_r), min_line_length_th );
-        detect_l.wait();
-        detect_r.wait();
+        TaskGraph::TaskId orb_l = graph.addTask( [&]{ detectPointFeatures( img_l, points_l, pdesc_l ); } );
+        TaskGraph::TaskId orb_r = graph.addTask( [&]{ detectPointFeatures( img_r, points_r, pdesc_r ); } );
+        graph.addTask( [&]{ matchStereoPoints( points_l, points_r, initial ); }, {orb_l, orb_r} );
     }
-    else
+
+    // Line segments detection and stereo matching (the pyramid of each image is computed once and
+    // shared by LSD and LBD, its gradients are computed while the lines are being detected; in
+    // coarse-to-fine mode LSD runs on a coarse octave and the segments are refined on the gradients)
+    ImagePyramid pyr_l, pyr_r;
+    if( Config::hasLines() && budget.lines )
     {
-        detectFeatures(img_l,points_l,pdesc_l,lines_l,ldesc_l,min_line_length_th);
-        detectFeatures(img_r,points_r,pdesc_r,lines_r,ldesc_r,min_line_length_th);
+        pyr_l.compute( img_l, Config::lsdCoarseOctave() + 1 );
+        pyr_r.compute( img_r, Config::lsdCoarseOctave() + 1 );
+        TaskGraph::TaskId grad_l = graph.addTask( [&]{ pyr_l.computeGradients(); } );
+        TaskGraph::TaskId grad_r = graph.addTask( [&]{ pyr_r.computeGradients(); } );
+        TaskGraph::TaskId lsd_l  = graph.addTask( [&]{ detectLineFeatures( pyr_l, lines_l, min_line_length_th ); } );
+        TaskGraph::TaskId lsd_r  = graph.addTask( [&]{ detectLineFeatures( pyr_r, lines_r, min_line_length_th ); } );
+        TaskGraph::TaskId ref_l  = graph.addTask( [&]{ refineLineFeatures( pyr_l, lines_l, min_line_length_th ); }, {lsd_l, grad_l} );
+        TaskGraph::TaskId ref_r  = graph.addTask( [&]{ refineLineFeatures( pyr_r, lines_r, min_line_length_th ); }, {lsd_r, grad_r} );
+        TaskGraph::TaskId lbd_l  = graph.addTask( [&]{ describeLineFeatures( pyr_l, lines_l, ldesc_l ); }, {ref_l} );
+        TaskGraph::TaskId lbd_r  = graph.addTask( [&]{ describeLineFeatures( pyr_r, lines_r, ldesc_r ); }, {ref_r} );
+        graph.addTask( [&]{ matchStereoLines( lines_l, lines_r, min_line_length_th, initial ); }, {lbd_l, lbd_r} );
     }
 
-    // Points stereo matching
-    if( Config::hasPoints() && !(points_l.size()==0) && !(points_r.size()==0) )
+    graph.run( Config::lrInParallel() );
+    timing.extraction = FeatureBudget::elapsedMs( t0 );
+
+}
+
+void StereoFrame::matchStereoPoints( const vector<KeyPoint> &points_l, const vector<KeyPoint> &points_r, bool initial )
+{
+
+    if( points_l.empty() || points_r.empty() )
+        return;
+
+    BFMatcher* bfm = new BFMatcher( NORM_HAMMING, false );
+    vector<vector<DMatch>> pmatches_lr, pmatches_rl;
+    Mat pdesc_l_;
+    stereo_pt.clear();
+    // LR and RL matches
+    if( Config::stereoBandMatch() )
     {
-        BFMatcher* bfm = new BFMatcher( NORM_HAMMING, false );
-        vector<vector<DMatch>> pmatches_lr, pmatches_rl, pmatches_lr_;
-        Mat pdesc_l_;
-        stereo_pt.clear();
-        // LR and RL matches
-        if( Config::bestLRMatches() )
-        {
-            if( Config::lrInParallel() )
-            {
-                auto match_l = async( launch::async, &StereoFrame::matchPointFeatures, this, bfm, pdesc_l, pdesc_r, ref(pmatches_lr) );
-                auto match_r = async( launch::async, &StereoFrame::matchPointFeatures, this, bfm, pdesc_r, pdesc_l, ref(pmatches_rl) );
-                match_l.wait();
-                match_r.wait();
-            }
-            else
-            {
-                bfm->knnMatch( pdesc_l, pdesc_r, pmatches_lr, 2);
-                bfm->knnMatch( pdesc_r, pdesc_l, pmatches_rl, 2);
-            }
-        }
-        else
-            bfm->knnMatch( pdesc_l, pdesc_r, pmatches_lr, 2);
+        // only the right points inside the epipolar band and disparity range of each left point
+        vector<vector<int>> candidates;
+        epipolarCandidates( points_l, points_r, candidates );
+        HammingMatcher::knnMatchCandidates( pdesc_l, pdesc_r, candidates, pmatches_lr, pmatches_rl, 2 );
+    }
+    else if( Config::bestLRMatches() )
+    {
+        matchFeaturesBidirectional( bfm, pdesc_l, pdesc_r, pmatches_lr, pmatches_rl );
+    }
+    else
+        matchPointFeatures( bfm, pdesc_l, pdesc_r, pmatches_lr );
 
-        // sort matches by the distance between the best and second best matches
-        double nn12_dist_th  = Config::minRatio12P();
+    // sort matches by the distance between the best and second best matches
+    double nn12_dist_th  = Config::minRatio12P();
 
-        // resort according to the queryIdx
+    // resort according to the queryIdx (the banded matches are already indexed by query and may be empty)
+    if( !Config::stereoBandMatch() )
+    {
         sort( pmatches_lr.begin(), pmatches_lr.end(), sort_descriptor_by_queryIdx() );
         if(Config::bestLRMatches())
             sort( pmatches_rl.begin(), pmatches_rl.end(), sort_descriptor_by_queryIdx() );
+    }
 
-        // bucle around pmatches
-        int pt_idx = 0;
-        for( int i = 0; i < pmatches_lr.size(); i++ )
+    // bucle around pmatches
+    int pt_idx = 0;
+    for( int i = 0; i < pmatches_lr.size(); i++ )
+    {
+        if( pmatches_lr[i].empty() )
+            continue;
+        int lr_qdx, lr_tdx, rl_tdx;
+        lr_qdx = pmatches_lr[i][0].queryIdx;
+        lr_tdx = pmatches_lr[i][0].trainIdx;
+        if( Config::bestLRMatches() )
         {
-            int lr_qdx, lr_tdx, rl_tdx;
-            lr_qdx = pmatches_lr[i][0].queryIdx;
-            lr_tdx = pmatches_lr[i][0].trainIdx;
-            if( Config::bestLRMatches() )
-            {
-                // check if they are mutual best matches
-                rl_tdx = pmatches_rl[lr_tdx][0].trainIdx;
-            }
-            else
-                rl_tdx = lr_qdx;
-            // check if they are mutual best matches and the minimum distance
-            double dist_12 = pmatches_lr[i][0].distance / pmatches_lr[i][1].distance;
-            if( lr_qdx == rl_tdx  && dist_12 > nn12_dist_th )
+            // check if they are mutual best matches
+            rl_tdx = pmatches_rl[lr_tdx][0].trainIdx;
+        }
+        else
+            rl_tdx = lr_qdx;
+        // check if they are mutual best matches and the minimum distance
+        // (a single candidate in the band has no rival, so it skips the ratio test)
+        bool ratio_ok = pmatches_lr[i].size() < 2 ||
+                        pmatches_lr[i][0].distance / pmatches_lr[i][1].distance > nn12_dist_th;
+        if( lr_qdx == rl_tdx  && ratio_ok )
+        {
+            // check stereo epipolar constraint
+            if( fabsf( points_l[lr_qdx].pt.y-points_r[lr_tdx].pt.y) <= Config::maxDistEpip() )
             {
-                // check stereo epipolar constraint
-                if( fabsf( points_l[lr_qdx].pt.y-points_r[lr_tdx].pt.y) <= Config::maxDistEpip() )
-                {
-                    // check minimal disparity
-                    double disp_ = points_l[lr_qdx].pt.x - points_r[lr_tdx].pt.x;
-                    if( disp_ >= Config::minDisp() ){
-                        pdesc_l_.push_back( pdesc_l.row(lr_qdx) );
-                        PointFeature* point_;
-                        Vector2d pl_; pl_ << points_l[lr_qdx].pt.x, points_l[lr_qdx].pt.y;
-                        Vector3d P_;  P_ = cam->backProjection( pl_(0), pl_(1), disp_);
-                        stereo_pt.push_back( new PointFeature(pl_,disp_,P_,pt_idx) );
-                        pt_idx++;
-                    }
+                // check minimal disparity
+                double disp_ = points_l[lr_qdx].pt.x - points_r[lr_tdx].pt.x;
+                if( disp_ >= Config::minDisp() ){
+                    Vector2d pl_; pl_ << points_l[lr_qdx].pt.x, points_l[lr_qdx].pt.y;
+                    Vector3d P_;  P_ = cam->backProjection( pl_(0), pl_(1), disp_);
+                    // the features of the first frame are indexed, the rest get their index when tracked
+                    pdesc_l_.push_back( pdesc_l.row(lr_qdx) );
+                    stereo_pt.push_back( arena->create<PointFeature>(pl_,disp_,P_, initial ? pt_idx : -1) );
+                    stereo_pt.back()->P_cov = cam->backProjectionCov( pl_(0), pl_(1), disp_ );
+                    pt_idx++;
                 }
             }
         }
-        pdesc_l_.copyTo(pdesc_l);
+    }
+    pdesc_l_.copyTo(pdesc_l);
+
+}
+
+void StereoFrame::epipolarCandidates( const vector<KeyPoint> &points_l, const vector<KeyPoint> &points_r, vector<vector<int>> &candidates )
+{
 
+    // bucket the right points by image row
+    int n_rows = cam->getHeight();
+    vector<vector<int>> rows_r( n_rows );
+    for( int j = 0; j < points_r.size(); j++ )
+    {
+        int v = min( max( int(points_r[j].pt.y), 0 ), n_rows-1 );
+        rows_r[v].push_back( j );
     }
 
-    // Line segments stereo matching
-    if( Config::hasLines() && !lines_l.empty() && !lines_r.empty() )
+    // right points within the epipolar band and with a valid disparity, sorted by index so that
+    // ties are resolved as in the brute-force matcher
+    double band = Config::maxDistEpip();
+    candidates.assign( points_l.size(), vector<int>() );
+    for( int i = 0; i < points_l.size(); i++ )
     {
-        stereo_ls.clear();
-        Ptr<BinaryDescriptorMatcher> bdm = BinaryDescriptorMatcher::createBinaryDescriptorMatcher();
-        BFMatcher* bfm = new BFMatcher( NORM_HAMMING, false );
-        vector<vector<DMatch>> lmatches_lr, lmatches_rl;
-        Mat ldesc_l_;
-        // LR and RL matches
-        if( Config::useBFMLines() )
+        const Point2f &pl = points_l[i].pt;
+        int v0 = max( int(floor(pl.y - band)), 0 );
+        int v1 = min( int(floor(pl.y + band)), n_rows-1 );
+        for( int v = v0; v <= v1; v++ )
         {
-            if( Config::bestLRMatches() )
+            for( int c = 0; c < rows_r[v].size(); c++ )
             {
-                if( Config::lrInParallel() )
-                {
-                    auto match_l = async( launch::async, &StereoFrame::matchLineFeaturesBFM, this, bfm, ldesc_l, ldesc_r, ref(lmatches_lr) );
-                    auto match_r = async( launch::async, &StereoFrame::matchLineFeaturesBFM, this, bfm, ldesc_r, ldesc_l, ref(lmatches_rl) );
-                    match_l.wait();
-                    match_r.wait();
-                }
-                else
-                {
-                    bfm->knnMatch( ldesc_l,ldesc_r, lmatches_lr, 2);
-                    bfm->knnMatch( ldesc_r,ldesc_l, lmatches_rl, 2);
-                }
+                const Point2f &pr = points_r[ rows_r[v][c] ].pt;
+                if( fabsf( pl.y - pr.y ) <= band && pl.x - pr.x >= Config::minDisp() )
+                    candidates[i].push_back( rows_r[v][c] );
             }
-            else
-                bfm->knnMatch( ldesc_l,ldesc_r, lmatches_lr, 2);
         }
+        sort( candidates[i].begin(), candidates[i].end() );
+    }
+
+}
+
+void StereoFrame::matchStereoLines( const vector<KeyLine> &lines_l, const vector<KeyLine> &lines_r, double min_line_length_th, bool initial )
+{
+
+    if( lines_l.empty() || lines_r.empty() )
+        return;
+
+    stereo_ls.clear();
+    Ptr<BinaryDescriptorMatcher> bdm = BinaryDescriptorMatcher::createBinaryDescriptorMatcher();
+    bdm->setMaxThreads( TaskGraph::threadShare( 2, Config::lrInParallel() ) );
+    BFMatcher* bfm = new BFMatcher( NORM_HAMMING, false );
+    vector<vector<DMatch>> lmatches_lr, lmatches_rl;
+    Mat ldesc_l_;
+    // LR and RL matches
+    if( Config::bestLRMatches() )
+    {
+        if( Config::useBFMLines() )
+            matchFeaturesBidirectional( bfm, ldesc_l, ldesc_r, lmatches_lr, lmatches_rl );
         else
         {
-            if( Config::bestLRMatches() )
-            {
-                if( Config::lrInParallel() )
-                {
-                    auto match_l = async( launch::async, &StereoFrame::matchLineFeatures, this, bdm, ldesc_l, ldesc_r, ref(lmatches_lr) );
-                    auto match_r = async( launch::async, &StereoFrame::matchLineFeatures, this, bdm, ldesc_r, ldesc_l, ref(lmatches_rl) );
-                    match_l.wait();
-                    match_r.wait();
-                }
-                else
-                {
-                    bdm->knnMatch( ldesc_l,ldesc_r, lmatches_lr, 2);
-                    bdm->knnMatch( ldesc_r,ldesc_l, lmatches_rl, 2);
-                }
-            }
-            else
-                bdm->knnMatch( ldesc_l,ldesc_r, lmatches_lr, 2);
+            TaskGraph graph;
+            graph.addTask( [&]{ matchLineFeatures( bdm, ldesc_l, ldesc_r, lmatches_lr ); } );
+            graph.addTask( [&]{ matchLineFeatures( bdm, ldesc_r, ldesc_l, lmatches_rl ); } );
+            graph.run( Config::lrInParallel() );
         }
+    }
+    else if( Config::useBFMLines() )
+        matchLineFeaturesBFM( bfm, ldesc_l, ldesc_r, lmatches_lr );
+    else
+        bdm->knnMatch( ldesc_l,ldesc_r, lmatches_lr, 2);
 
-        // // sort matches by the distance between the best and second best matches
-        double nn_dist_th, nn12_dist_th;
-        lineDescriptorMAD(lmatches_lr,nn_dist_th, nn12_dist_th);        
-        nn12_dist_th  = nn12_dist_th * Config::descThL();
+    // sort matches by the distance between the best and second best matches
+    double nn_dist_th, nn12_dist_th;
+    lineDescriptorMAD(lmatches_lr,nn_dist_th, nn12_dist_th);
+    nn12_dist_th  = nn12_dist_th * Config::descThL();
 
-        // bucle around pmatches
-        sort( lmatches_lr.begin(), lmatches_lr.end(), sort_descriptor_by_queryIdx() );
-        if( Config::bestLRMatches() )
-            sort( lmatches_rl.begin(), lmatches_rl.end(), sort_descriptor_by_queryIdx() );
+    // bucle around pmatches
+    sort( lmatches_lr.begin(), lmatches_lr.end(), sort_descriptor_by_queryIdx() );
+    if( Config::bestLRMatches() )
+        sort( lmatches_rl.begin(), lmatches_rl.end(), sort_descriptor_by_queryIdx() );
+
+    int n_matches;
+    if( Config::bestLRMatches() )
+        n_matches = min(lmatches_lr.size(),lmatches_rl.size());
+    else
+        n_matches = lmatches_lr.size();
 
-        int n_matches;
+    int ls_idx = 0;
+    for( int i = 0; i < n_matches; i++ )
+    {
+        // check if they are mutual best matches ( if bestLRMatches() )
+        int lr_qdx = lmatches_lr[i][0].queryIdx;
+        int lr_tdx = lmatches_lr[i][0].trainIdx;
+        int rl_tdx;
         if( Config::bestLRMatches() )
-            n_matches = min(lmatches_lr.size(),lmatches_rl.size());
+            rl_tdx = lmatches_rl[lr_tdx][0].trainIdx;
         else
-            n_matches = lmatches_lr.size();
-
-        int ls_idx = 0;
-        for( int i = 0; i < n_matches; i++ )
+            rl_tdx = lr_qdx;
+        // check if they are mutual best matches and the minimum distance
+        double dist_12 = lmatches_lr[i][1].distance - lmatches_lr[i][0].distance;
+        double length  = lines_r[lr_tdx].lineLength;
+        if( lr_qdx == rl_tdx && length > min_line_length_th && dist_12 > nn12_dist_th )
         {
-            // check if they are mutual best matches ( if bestLRMatches() )
-            int lr_qdx = lmatches_lr[i][0].queryIdx;
-            int lr_tdx = lmatches_lr[i][0].trainIdx;
-            int rl_tdx;
-            if( Config::bestLRMatches() )
-                rl_tdx = lmatches_rl[lr_tdx][0].trainIdx;
-            else
-                rl_tdx = lr_qdx;
-            // check if they are mutual best matches and the minimum distance
-            double dist_12 = lmatches_lr[i][1].distance - lmatches_lr[i][0].distance;
-            double length  = lines_r[lr_tdx].lineLength;
-
-            if( lr_qdx == rl_tdx && length > min_line_length_th && dist_12 > nn12_dist_th )
+            // check stereo epipolar constraint
+            if( fabsf(lines_l[lr_qdx].angle) >= Config::minHorizAngle() && fabsf(lines_r[lr_tdx].angle) >= Config::minHorizAngle() && fabsf(angDiff(lines_l[lr_qdx].angle,lines_r[lr_tdx].angle)) < Config::maxAngleDiff() )
             {
-                // check stereo epipolar constraint
-                if( fabsf(lines_l[lr_qdx].angle) >= Config::minHorizAngle() && fabsf(lines_r[lr_tdx].angle) >= Config::minHorizAngle() && fabsf(angDiff(lines_l[lr_qdx].angle,lines_r[lr_tdx].angle)) < Config::maxAngleDiff() )
+                // estimate the disparity of the endpoints
+                Vector3d sp_r; sp_r << lines_r[lr_tdx].startPointX, lines_r[lr_tdx].startPointY, 1.0;
+                Vector3d ep_r; ep_r << lines_r[lr_tdx].endPointX,   lines_r[lr_tdx].endPointY,   1.0;
+                Vector3d le_r; le_r << sp_r.cross(ep_r);
+                sp_r << - (le_r(2)+le_r(1)*lines_l[lr_qdx].startPointY )/le_r(0) , lines_l[lr_qdx].startPointY ,  1.0;
+                ep_r << - (le_r(2)+le_r(1)*lines_l[lr_qdx].endPointY   )/le_r(0) , lines_l[lr_qdx].endPointY ,    1.0;
+                double disp_s = lines_l[lr_qdx].startPointX - sp_r(0);
+                double disp_e = lines_l[lr_qdx].endPointX   - ep_r(0);
+                Vector3d sp_l; sp_l << lines_l[lr_qdx].startPointX, lines_l[lr_qdx].startPointY, 1.0;
+                Vector3d ep_l; ep_l << lines_l[lr_qdx].endPointX,   lines_l[lr_qdx].endPointY,   1.0;
+                Vector3d le_l; le_l << sp_l.cross(ep_l); le_l = le_l / sqrt( le_l(0)*le_l(0) + le_l(1)*le_l(1) );
+                // check minimal disparity
+                if( disp_s >= Config::minDisp() && disp_e >= Config::minDisp() && fabsf(le_r(0)) > Config::lineHorizTh() )
                 {
-                    // estimate the disparity of the endpoints
-                    Vector3d sp_r; sp_r << lines_r[lr_tdx].startPointX, lines_r[lr_tdx].startPointY, 1.0;
-                    Vector3d ep_r; ep_r << lines_r[lr_tdx].endPointX,   lines_r[lr_tdx].endPointY,   1.0;
-                    Vector3d le_r; le_r << sp_r.cross(ep_r);
-                    sp_r << - (le_r(2)+le_r(1)*lines_l[lr_qdx].startPointY )/le_r(0) , lines_l[lr_qdx].startPointY ,  1.0;
-                    ep_r << - (le_r(2)+le_r(1)*lines_l[lr_qdx].endPointY   )/le_r(0) , lines_l[lr_qdx].endPointY ,    1.0;
-                    double disp_s = lines_l[lr_qdx].startPointX - sp_r(0);
-                    double disp_e = lines_l[lr_qdx].endPointX   - ep_r(0);
-                    Vector3d sp_l; sp_l << lines_l[lr_qdx].startPointX, lines_l[lr_qdx].startPointY, 1.0;
-                    Vector3d ep_l; ep_l << lines_l[lr_qdx].endPointX,   lines_l[lr_qdx].endPointY,   1.0;
-                    Vector3d le_l; le_l << sp_l.cross(ep_l); le_l = le_l / sqrt( le_l(0)*le_l(0) + le_l(1)*le_l(1) );
-                    // check minimal disparity
-                    if( disp_s >= Config::minDisp() && disp_e >= Config::minDisp() && fabsf(le_r(0)) > Config::lineHorizTh() )
+                    Vector3d sP_; sP_ = cam->backProjection( sp_l(0), sp_l(1), disp_s);
+                    Vector3d eP_; eP_ = cam->backProjection( ep_l(0), ep_l(1), disp_e);
+                    Matrix3d sP_cov = cam->backProjectionCov( sp_l(0), sp_l(1), disp_s );
+                    Matrix3d eP_cov = cam->backProjectionCov( ep_l(0), ep_l(1), disp_e );
+                    double angle_l = lines_l[lr_qdx].angle;
+                    // the features of the first frame are indexed, the rest get their index when tracked
+                    if( initial )
                     {
                         ldesc_l_.push_back( ldesc_l.row(lr_qdx) );
-                        Vector3d sP_; sP_ = cam->backProjection( sp_l(0), sp_l(1), disp_s);
-                        Vector3d eP_; eP_ = cam->backProjection( ep_l(0), ep_l(1), disp_e);
-                        double angle_l = lines_l[lr_qdx].angle;
-                        stereo_ls.push_back( new LineFeature(Vector2d(sp_l(0),sp_l(1)),disp_s,sP_,Vector2d(ep_l(0),ep_l(1)),disp_e,eP_,le_l,angle_l,ls_idx) );
+                        stereo_ls.push_back( arena->create<LineFeature>(Vector2d(sp_l(0),sp_l(1)),disp_s,sP_,Vector2d(ep_l(0),ep_l(1)),disp_e,eP_,le_l,angle_l,ls_idx) );
+                        stereo_ls.back()->sP_cov = sP_cov;
+                        stereo_ls.back()->eP_cov = eP_cov;
                         ls_idx++;
+                        continue;
                     }
+                    //----------------- DEBUG: 24/05/2016 ----------------------
+                    // estimate the uncertainty of the endpoints
+                    double b2 = cam->getB() * cam->getB();
+                    Matrix3d covS_an = sP_cov * b2;
+                    Matrix3d covE_an = eP_cov * b2;
+                    // - estimate eigenvalues
+                    Vector3d S_eigen, E_eigen;
+                    SelfAdjointEigenSolver<Matrix3d> eigensolver_s(covS_an);
+                    S_eigen = eigensolver_s.eigenvalues();
+                    SelfAdjointEigenSolver<Matrix3d> eigensolver_e(covE_an);
+                    E_eigen = eigensolver_e.eigenvalues();
+                    double max_eig = max( S_eigen(2),E_eigen(2) );
+                    // - dbg plot
+                    if(max_eig < Config::lineCovTh())
+                    //if(max_eig < Config::lineCovTh() && sP_(2) < 30.0 && eP_(2) < 30.0 )
+                    {
+                        ldesc_l_.push_back( ldesc_l.row(lr_qdx) );
+                        stereo_ls.push_back( arena->create<LineFeature>(Vector2d(sp_l(0),sp_l(1)),disp_s,sP_,Vector2d(ep_l(0),ep_l(1)),disp_e,eP_,le_l,angle_l,-1) );
+                        stereo_ls.back()->sP_cov = sP_cov;
+                        stereo_ls.back()->eP_cov = eP_cov;
+                    }
+                    //----------------------------------------------------------
                 }
             }
         }
-        ldesc_l_.copyTo(ldesc_l);
-
     }
+    ldesc_l_.copyTo(ldesc_l);
+
+    // index of the stereo matched descriptors, train set of the f2f matching against this frame
+    if( !Config::useBFMLines() )
+        ldesc_index.build( ldesc_l );
 
 }
 
-void StereoFrame::extractStereoFeatures()
+void StereoFrame::detectPointFeatures( Mat img, vector<KeyPoint> &points, Mat &pdesc )
 {
-
-    // Feature detection and description
-    vector<KeyPoint> points_l, points_r;
-    vector<KeyLine>  lines_l, lines_r;
-    double min_line_length_th = Config::minLineLength() * std::min( cam->getWidth(), cam->getHeight() ) ;
-    if( Config::lrInParallel() )
+    if( Config::useBRISK() )
     {
-        auto detect_l = async(launch::async, &StereoFrame::detectFeatures, this, img_l, ref(points_l), ref(pdesc_l), ref(lines_l), ref(ldesc_l), min_line_length_th );
-        auto detect_r = async(launch::async, &StereoFrame::detectFeatures, this, img_r, ref(points_r), ref(pdesc_r), ref(lines_r), ref(ldesc_r), min_line_length_th );
-        detect_l.wait();
-        detect_r.wait();
+        Ptr<BRISK> brisk = BRISK::create( Config::brsThreshold(), Config::brsNLevels(), Config::brsScaleFactor() );
+        brisk->detectAndCompute( img, Mat(), points, pdesc, false);
     }
+    else if( Config::orbGridCols() * Config::orbGridRows() > 1 )
+        detectPointFeaturesTiled( img, points, pdesc );
     else
     {
-        detectFeatures(img_l,points_l,pdesc_l,lines_l,ldesc_l,min_line_length_th);
-        detectFeatures(img_r,points_r,pdesc_r,lines_r,ldesc_r,min_line_length_th);
+        Ptr<ORB> orb = ORB::create( budget.orb_nfeatures, Config::orbScaleFactor(), Config::orbNLevels() );
+        orb->detectAndCompute( img, Mat(), points, pdesc, false);
     }
+}
+
+void StereoFrame::detectPointFeaturesTiled( Mat img, vector<KeyPoint> &points, Mat &pdesc )
+{
 
-    // Points stereo matching
-    if( Config::hasPoints() && !(points_l.size()==0) && !(points_r.size()==0) )
+    // grid of tiles, each one detected and described over a region padded with the ORB border (patch + pyramid)
+    int n_cols     = max( 1, Config::orbGridCols() );
+    int n_rows     = max( 1, Config::orbGridRows() );
+    int n_tiles    = n_cols * n_rows;
+    int n_features = budget.orb_nfeatures;
+    int margin     = cvCeil( 31.0 * pow( Config::orbScaleFactor(), Config::orbNLevels()-1 ) ) + 1;
+    vector<Rect> tiles, rois;
+    for( int r = 0; r < n_rows; r++ )
     {
-        BFMatcher* bfm = new BFMatcher( NORM_HAMMING, false );
-        vector<vector<DMatch>> pmatches_lr, pmatches_rl, pmatches_lr_;
-        Mat pdesc_l_;
-        stereo_pt.clear();
-        // LR and RL matches
-        if( Config::bestLRMatches() )
+        for( int c = 0; c < n_cols; c++ )
         {
-            if( Config::lrInParallel() )
-            {
-                auto match_l = async( launch::async, &StereoFrame::matchPointFeatures, this, bfm, pdesc_l, pdesc_r, ref(pmatches_lr) );
-                auto match_r = async( launch::async, &StereoFrame::matchPointFeatures, this, bfm, pdesc_r, pdesc_l, ref(pmatches_rl) );
-                match_l.wait();
-                match_r.wait();
-            }
-            else
-            {
-                bfm->knnMatch( pdesc_l, pdesc_r, pmatches_lr, 2);
-                bfm->knnMatch( pdesc_r, pdesc_l, pmatches_rl, 2);
-            }
+            int x0 = c * img.cols / n_cols, x1 = (c+1) * img.cols / n_cols;
+            int y0 = r * img.rows / n_rows, y1 = (r+1) * img.rows / n_rows;
+            tiles.push_back( Rect( x0, y0, x1-x0, y1-y0 ) );
+            rois.push_back( Rect( x0-margin, y0-margin, x1-x0+2*margin, y1-y0+2*margin ) & Rect( 0, 0, img.cols, img.rows ) );
         }
-        else
-            bfm->knnMatch( pdesc_l, pdesc_r, pmatches_lr, 2);
-
-        // sort matches by the distance between the best and second best matches
-        double nn12_dist_th  = Config::minRatio12P();
-
-        // resort according to the queryIdx
-        sort( pmatches_lr.begin(), pmatches_lr.end(), sort_descriptor_by_queryIdx() );
-        if(Config::bestLRMatches())
-            sort( pmatches_rl.begin(), pmatches_rl.end(), sort_descriptor_by_queryIdx() );
+    }
 
-        // bucle around pmatches
-        for( int i = 0; i < pmatches_lr.size(); i++ )
-        {
-            int lr_qdx, lr_tdx, rl_tdx;
-            lr_qdx = pmatches_lr[i][0].queryIdx;
-            lr_tdx = pmatches_lr[i][0].trainIdx;
-            if( Config::bestLRMatches() )
+    // detect the tiles in parallel (with twice their share of the budget, to redistribute it afterwards),
+    // select the features of the whole image and describe them again per tile
+    vector<vector<KeyPoint>> tile_points(n_tiles);
+    vector<Mat>              tile_desc(n_tiles);
+    vector<TaskGraph::TaskId> detect_tasks;
+    TaskGraph graph;
+    for( int i = 0; i < n_tiles; i++ )
+    {
+        detect_tasks.push_back( graph.addTask( [&,i]{
+            Ptr<ORB> orb = ORB::create( 2 * n_features / n_tiles + 1, Config::orbScaleFactor(), Config::orbNLevels() );
+            vector<KeyPoint> points_;
+            orb->detect( img(rois[i]), points_ );
+            for( int j = 0; j < points_.size(); j++ )
             {
-                // check if they are mutual best matches
-                rl_tdx = pmatches_rl[lr_tdx][0].trainIdx;
+                // keep only the features whose center lies in the tile (the margin belongs to the neighbours)
+                points_[j].pt += Point2f( rois[i].x, rois[i].y );
+                if( points_[j].pt.x >= tiles[i].x && points_[j].pt.x < tiles[i].x + tiles[i].width &&
+                    points_[j].pt.y >= tiles[i].y && points_[j].pt.y < tiles[i].y + tiles[i].height )
+                    tile_points[i].push_back( points_[j] );
             }
-            else
-                rl_tdx = lr_qdx;
-            // check if they are mutual best matches and the minimum distance
-            double dist_12 = pmatches_lr[i][0].distance / pmatches_lr[i][1].distance;
-            if( lr_qdx == rl_tdx  && dist_12 > nn12_dist_th )
-            {
-                // check stereo epipolar constraint
-                if( fabsf( points_l[lr_qdx].pt.y-points_r[lr_tdx].pt.y) <= Config::maxDistEpip() )
-                {
-                    // check minimal disparity
-                    double disp_ = points_l[lr_qdx].pt.x - points_r[lr_tdx].pt.x;
-                    if( disp_ >= Config::minDisp() ){
-                        PointFeature* point_;
-                        Vector2d pl_; pl_ << points_l[lr_qdx].pt.x, points_l[lr_qdx].pt.y;
-                        Vector3d P_;  P_ = cam->backProjection( pl_(0), pl_(1), disp_);
-                        //if( P_(2) < 30.0 )
-                        {
-                            pdesc_l_.push_back( pdesc_l.row(lr_qdx) );
-                            stereo_pt.push_back( new PointFeature(pl_,disp_,P_,-1) );
-                        }
-                    }
-                }
-            }
-        }
-        pdesc_l_.copyTo(pdesc_l);
+            stable_sort( tile_points[i].begin(), tile_points[i].end(), sort_keypoints_by_response() );
+        } ) );
+    }
+    TaskGraph::TaskId select = graph.addTask( [&]{ selectTileFeatures( tile_points, n_features ); }, detect_tasks );
+    for( int i = 0; i < n_tiles; i++ )
+    {
+        graph.addTask( [&,i]{
+            if( tile_points[i].empty() )
+                return;
+            for( int j = 0; j < tile_points[i].size(); j++ )
+                tile_points[i][j].pt -= Point2f( rois[i].x, rois[i].y );
+            Ptr<ORB> orb = ORB::create( n_features, Config::orbScaleFactor(), Config::orbNLevels() );
+            orb->compute( img(rois[i]), tile_points[i], tile_desc[i] );
+            for( int j = 0; j < tile_points[i].size(); j++ )
+                tile_points[i][j].pt += Point2f( rois[i].x, rois[i].y );
+        }, {select} );
+    }
+    graph.run( Config::lrInParallel() );
 
+    // merge the tiles (in raster order)
+    points.clear();
+    pdesc = Mat();
+    for( int i = 0; i < n_tiles; i++ )
+    {
+        if( tile_points[i].empty() )
+            continue;
+        points.insert( points.end(), tile_points[i].begin(), tile_points[i].end() );
+        pdesc.push_back( tile_desc[i] );
     }
 
-    // Line segments stereo matching
-    if( Config::hasLines() && !lines_l.empty() && !lines_r.empty() )
+}
+
+void StereoFrame::selectTileFeatures( vector<vector<KeyPoint>> &tile_points, int n_features )
+{
+
+    // each tile keeps its strongest features up to an even share of the budget (tile_points sorted by response)
+    int n_tiles = tile_points.size();
+    int quota   = n_features / n_tiles;
+    int n_kept  = 0;
+    vector<int>      n_keep(n_tiles);
+    vector<KeyPoint> spare;
+    for( int i = 0; i < n_tiles; i++ )
     {
-        stereo_ls.clear();
-        Ptr<BinaryDescriptorMatcher> bdm = BinaryDescriptorMatcher::createBinaryDescriptorMatcher();
-        BFMatcher* bfm = new BFMatcher( NORM_HAMMING, false );
-        vector<vector<DMatch>> lmatches_lr, lmatches_rl;
-        Mat ldesc_l_;
-        // LR and RL matches
-        if( Config::useBFMLines() )
+        n_keep[i] = min( quota, int(tile_points[i].size()) );
+        n_kept   += n_keep[i];
+        for( int j = n_keep[i]; j < tile_points[i].size(); j++ )
         {
-            if( Config::bestLRMatches() )
-            {
-                if( Config::lrInParallel() )
-                {
-                    auto match_l = async( launch::async, &StereoFrame::matchLineFeaturesBFM, this, bfm, ldesc_l, ldesc_r, ref(lmatches_lr) );
-                    auto match_r = async( launch::async, &StereoFrame::matchLineFeaturesBFM, this, bfm, ldesc_r, ldesc_l, ref(lmatches_rl) );
-                    match_l.wait();
-                    match_r.wait();
-                }
-                else
-                {
-                    bfm->knnMatch( ldesc_l,ldesc_r, lmatches_lr, 2);
-                    bfm->knnMatch( ldesc_r,ldesc_l, lmatches_rl, 2);
-                }
-            }
-            else
-                bfm->knnMatch( ldesc_l,ldesc_r, lmatches_lr, 2);
+            spare.push_back( tile_points[i][j] );
+            spare.back().class_id = i;
         }
-        else
+    }
+
+    // the share left by the tiles with fewer features goes to the strongest spare features of the image
+    stable_sort( spare.begin(), spare.end(), sort_keypoints_by_response() );
+    for( int k = 0; k < spare.size() && n_kept < n_features; k++, n_kept++ )
+        n_keep[ spare[k].class_id ]++;
+    for( int i = 0; i < n_tiles; i++ )
+        tile_points[i].resize( n_keep[i] );
+
+}
+
+void StereoFrame::detectLineFeatures( const ImagePyramid &pyr, vector<KeyLine> &lines, double min_line_length )
+{
+    lines.clear();
+    if( Config::useEDLines() )
+    {
+        // EDLines parameters
+        BinaryDescriptor::EDLineParam opts;
+        opts.ksize               = Config::edlKsize();
+        opts.sigma               = Config::edlSigma();
+        opts.gradientThreshold   = Config::edlGradientTh();
+        opts.anchorThreshold     = Config::edlAnchorTh();
+        opts.scanIntervals       = Config::edlScanInterv();
+        opts.minLineLen          = Config::edlMinLineLen();
+        opts.lineFitErrThreshold = Config::edlFitErrTh();
+        BinaryDescriptor::EDLineDetector* edl = new BinaryDescriptor::EDLineDetector(opts);
+        BinaryDescriptor::LineChains lines_;
+        Mat img = pyr.octaves[0];
+        edl->EDline(img,lines_);
+        int idx_aux = 0;
+        for(int i = 0; i < edl->lineEndpoints_.size(); i++)
         {
-            if( Config::bestLRMatches() )
+            KeyLine l_;
+            // estimate endpoints from LineChains
+            int s_idx = lines_.sId[i];
+            int e_idx = lines_.sId[i+1] - 1;
+            float sx  = edl->lineEndpoints_[i][0];
+            float sy  = edl->lineEndpoints_[i][1];
+            float ex  = edl->lineEndpoints_[i][2];
+            float ey  = edl->lineEndpoints_[i][3];
+            double line_length = sqrt( double( pow(ex-sx,2) + pow(ey-sy,2) ) );
+            // create keyline
+            if( line_length > min_line_length )
             {
-                if( Config::lrInParallel() )
-                {
-                    auto match_l = async( launch::async, &StereoFrame::matchLineFeatures, this, bdm, ldesc_l, ldesc_r, ref(lmatches_lr) );
-                    auto match_r = async( launch::async, &StereoFrame::matchLineFeatures, this, bdm, ldesc_r, ldesc_l, ref(lmatches_rl) );
-                    match_l.wait();
-                    match_r.wait();
-                }
-                else
-                {
-                    bdm->knnMatch( ldesc_l,ldesc_r, lmatches_lr, 2);
-                    bdm->knnMatch( ldesc_r,ldesc_l, lmatches_rl, 2);
-                }
+                l_.angle       = edl->lineDirection_[i];
+                l_.startPointX = sx;    l_.sPointInOctaveX = sx;
+                l_.startPointY = sy;    l_.sPointInOctaveY = sy;
+                l_.endPointX   = ex;    l_.ePointInOctaveX = ex;
+                l_.endPointY   = ey;    l_.ePointInOctaveY = ey;
+                l_.lineLength  = line_length;
+                l_.octave      = 0;
+                l_.class_id    = idx_aux;
+                l_.numOfPixels = e_idx - s_idx;
+                l_.response    = line_length / double(max( img_l.cols, img_l.rows ));
+                lines.push_back(l_);
+                idx_aux++;
             }
-            else
-                bdm->knnMatch( ldesc_l,ldesc_r, lmatches_lr, 2);
         }
-        // sort matches by the distance between the best and second best matches
-        double nn_dist_th, nn12_dist_th;
-        lineDescriptorMAD(lmatches_lr,nn_dist_th, nn12_dist_th);
-        nn12_dist_th  = nn12_dist_th * Config::descThL();
-
-        // bucle around pmatches
-        sort( lmatches_lr.begin(), lmatches_lr.end(), sort_descriptor_by_queryIdx() );
-        if( Config::bestLRMatches() )
-            sort( lmatches_rl.begin(), lmatches_rl.end(), sort_descriptor_by_queryIdx() );
-
-        int n_matches;
-        if( Config::bestLRMatches() )
-            n_matches = min(lmatches_lr.size(),lmatches_rl.size());
+    }
+    else
+    {
+        Ptr<LSDDetector>        lsd = LSDDetector::createLSDDetector();
+        // lsd parameters
+        LSDDetector::LSDOptions opts;
+        opts.refine       = Config::lsdRefine();
+        opts.scale        = budget.lsd_scale;
+        opts.sigma_scale  = Config::lsdSigmaScale();
+        opts.quant        = Config::lsdQuant();
+        opts.ang_th       = Config::lsdAngTh();
+        opts.log_eps      = Config::lsdLogEps();
+        opts.density_th   = Config::lsdDensityTh();
+        opts.n_bins       = Config::lsdNBins();
+        opts.min_length   = min_line_length;
+        opts.grid_cols    = Config::lsdGridCols();
+        opts.grid_rows    = Config::lsdGridRows();
+        opts.tile_overlap = Config::lsdTileOverlap();
+        opts.merge_ang_th = Config::lsdMergeAngTh();
+        opts.merge_dist_th= Config::lsdMergeDistTh();
+
+        int octave = coarseLineOctave( pyr );
+        if( octave == 0 )
+            lsd->detect( pyr.octaves, lines, pyr.ratio, opts);
         else
-            n_matches = lmatches_lr.size();
-
-        for( int i = 0; i < n_matches; i++ )
         {
-            // check if they are mutual best matches ( if bestLRMatches() )
-            int lr_qdx = lmatches_lr[i][0].queryIdx;
-            int lr_tdx = lmatches_lr[i][0].trainIdx;
-            int rl_tdx;
-            if( Config::bestLRMatches() )
-                rl_tdx = lmatches_rl[lr_tdx][0].trainIdx;
-            else
-                rl_tdx = lr_qdx;
-            // check if they are mutual best matches and the minimum distance
-            double dist_12 = lmatches_lr[i][1].distance - lmatches_lr[i][0].distance;
-            double length  = lines_r[lr_tdx].lineLength;
-            if( lr_qdx == rl_tdx && length > min_line_length_th && dist_12 > nn12_dist_th )
+            // detect on the coarse octave and bring the segments to full resolution (refined later)
+            float s = pow( (float) pyr.ratio, octave );
+            opts.min_length    /= s;
+            opts.tile_overlap   = std::max( 1, int( opts.tile_overlap / s ) );
+            opts.merge_dist_th /= s;
+            lsd->detect( vector<Mat>( 1, pyr.octaves[octave] ), lines, pyr.ratio, opts);
+            for( auto &l : lines )
             {
-                // check stereo epipolar constraint
-                if( fabsf(lines_l[lr_qdx].angle) >= Config::minHorizAngle() && fabsf(lines_r[lr_tdx].angle) >= Config::minHorizAngle() && fabsf(angDiff(lines_l[lr_qdx].angle,lines_r[lr_tdx].angle)) < Config::maxAngleDiff() )
-                {
-                    // estimate the disparity of the endpoints
-                    Vector3d sp_r; sp_r << lines_r[lr_tdx].startPointX, lines_r[lr_tdx].startPointY, 1.0;
-                    Vector3d ep_r; ep_r << lines_r[lr_tdx].endPointX,   lines_r[lr_tdx].endPointY,   1.0;
-                    Vector3d le_r; le_r << sp_r.cross(ep_r);
-                    sp_r << - (le_r(2)+le_r(1)*lines_l[lr_qdx].startPointY )/le_r(0) , lines_l[lr_qdx].startPointY ,  1.0;
-                    ep_r << - (le_r(2)+le_r(1)*lines_l[lr_qdx].endPointY   )/le_r(0) , lines_l[lr_qdx].endPointY ,    1.0;
-                    double disp_s = lines_l[lr_qdx].startPointX - sp_r(0);
-                    double disp_e = lines_l[lr_qdx].endPointX   - ep_r(0);
-                    Vector3d sp_l; sp_l << lines_l[lr_qdx].startPointX, lines_l[lr_qdx].startPointY, 1.0;
-                    Vector3d ep_l; ep_l << lines_l[lr_qdx].endPointX,   lines_l[lr_qdx].endPointY,   1.0;
-                    Vector3d le_l; le_l << sp_l.cross(ep_l); le_l = le_l / sqrt( le_l(0)*le_l(0) + le_l(1)*le_l(1) );
-                    // check minimal disparity
-                    if( disp_s >= Config::minDisp() && disp_e >= Config::minDisp() && fabsf(le_r(0)) > Config::lineHorizTh() )
-                    {
-                        Vector3d sP_; sP_ = cam->backProjection( sp_l(0), sp_l(1), disp_s);
-                        Vector3d eP_; eP_ = cam->backProjection( ep_l(0), ep_l(1), disp_e);
-                        double angle_l = lines_l[lr_qdx].angle;
-                        //----------------- DEBUG: 24/05/2016 ----------------------
-                        // estimate the uncertainty of the endpoints
-                        double cx = cam->getCx();
-                        double cy = cam->getCy();
-                        double f  = cam->getFx();
-                        // - start point
-                        double px_hat = sp_l(0) - cx;
-                        double py_hat = sp_l(1) - cy;
-                        double disp   = disp_s;
-                        double disp2  = disp * disp;
-                        Matrix3d covS_an;
-                        covS_an(0,0) = disp2+2.f*px_hat*px_hat;
-                        covS_an(0,1) = 2.f*px_hat*py_hat;
-                        covS_an(0,2) = 2.f*f*px_hat;
-                        covS_an(1,1) = disp2+2.f*py_hat*py_hat;
-                        covS_an(1,2) = 2.f*f*py_hat;
-                        covS_an(2,2) = 2.f*f*f;
-                        covS_an(1,0) = covS_an(0,1);
-                        covS_an(2,0) = covS_an(0,2);
-                        covS_an(2,1) = covS_an(1,2);
-                        covS_an << covS_an * cam->getB() * cam->getB() / (disp2*disp2);
-                        // - end point
-                        px_hat = ep_l(0) - cam->getCx();
-                        py_hat = ep_l(1) - cam->getCy();
-                        disp   = disp_e;
-                        disp2  = disp * disp;
-                        Matrix3d covE_an;
-                        covE_an(0,0) = disp2+2.f*px_hat*px_hat;
-                        covE_an(0,1) = 2.f*px_hat*py_hat;
-                        covE_an(0,2) = 2.f*f*px_hat;
-                        covE_an(1,1) = disp2+2.f*py_hat*py_hat;
-                        covE_an(1,2) = 2.f*f*py_hat;
-                        covE_an(2,2) = 2.f*f*f;
-                        covE_an(1,0) = covE_an(0,1);
-                        covE_an(2,0) = covE_an(0,2);
-                        covE_an(2,1) = covE_an(1,2);
-                        covE_an << covE_an * cam->getB() * cam->getB() / (disp2*disp2);
-                        // - estimate eigenvalues
-                        Vector3d S_eigen, E_eigen;
-                        SelfAdjointEigenSolver<Matrix3d> eigensolver_s(covS_an);
-                        S_eigen = eigensolver_s.eigenvalues();
-                        SelfAdjointEigenSolver<Matrix3d> eigensolver_e(covE_an);
-                        E_eigen = eigensolver_e.eigenvalues();
-                        double max_eig = max( S_eigen(2),E_eigen(2) );
-                        // - dbg plot
-                        if(max_eig < Config::lineCovTh())
-                        //if(max_eig < Config::lineCovTh() && sP_(2) < 30.0 && eP_(2) < 30.0 )
-                        {
-                            ldesc_l_.push_back( ldesc_l.row(lr_qdx) );
-                            stereo_ls.push_back( new LineFeature(Vector2d(sp_l(0),sp_l(1)),disp_s,sP_,Vector2d(ep_l(0),ep_l(1)),disp_e,eP_,le_l,angle_l,-1) );
-                        }
-                        //----------------------------------------------------------
-                    }
-                }
+                l.startPointX *= s;    l.sPointInOctaveX = l.startPointX;
+                l.startPointY *= s;    l.sPointInOctaveY = l.startPointY;
+                l.endPointX   *= s;    l.ePointInOctaveX = l.endPointX;
+                l.endPointY   *= s;    l.ePointInOctaveY = l.endPointY;
+                l.lineLength  *= s;
             }
         }
-        ldesc_l_.copyTo(ldesc_l);
-
-    }  
+    }
 
 }
 
-void StereoFrame::detectFeatures(Mat img, vector<KeyPoint> &points, Mat &pdesc, vector<KeyLine> &lines, Mat &ldesc, double min_line_length)
+int StereoFrame::coarseLineOctave( const ImagePyramid &pyr )
 {
+    if( Config::useEDLines() )
+        return 0;
+    return std::max( 0, std::min( Config::lsdCoarseOctave(), pyr.size() - 1 ) );
+}
 
-    // Declare objects
-    Ptr<BinaryDescriptor>   lbd = BinaryDescriptor::createBinaryDescriptor();
+void StereoFrame::refineLineFeatures( const ImagePyramid &pyr, vector<KeyLine> &lines, double min_line_length )
+{
 
-    // Detect point features
-    if( Config::hasPoints() )
+    // segments detected on a coarse octave are refined on the full resolution gradient: the edge is
+    // searched along the normal of the segment within a thin band, at every pixel along it (and one
+    // coarse pixel beyond each endpoint), the supported span around the middle gives the endpoints and
+    // a weighted fit of the edge points gives the line
+    int octave = coarseLineOctave( pyr );
+    if( octave == 0 || lines.empty() )
+        return;
+
+    const Mat &dx = pyr.dx[0], &dy = pyr.dy[0];
+    const int    cols    = dx.cols, rows = dx.rows;
+    const double s       = pow( double(pyr.ratio), octave );
+    const int    band    = std::max( 1, int( round( Config::lsdCoarseBand() * s ) ) );
+    const int    ext     = int( ceil( s ) );
+    const double cos_th  = cos( 2.0 * Config::lsdAngTh() * CV_PI / 180.0 );   // the gradient bends at the ends of an edge
+
+    vector<KeyLine> refined;
+    refined.reserve( lines.size() );
+    vector<double> off, mag, proj_band( 2 * band + 1 );
+    vector<int>    sgn;
+    for( const auto &l : lines )
     {
-        if( Config::useBRISK() )
-        {
-            Ptr<BRISK> brisk = BRISK::create( Config::brsThreshold(), Config::brsNLevels(), Config::brsScaleFactor() );
-            brisk->detectAndCompute( img, Mat(), points, pdesc, false);
-        }
-        else
+        Vector2d p0( l.startPointX, l.startPointY ), p1( l.endPointX, l.endPointY );
+        double len = ( p1 - p0 ).norm();
+        if( len < 1.0 )
+            continue;
+        Vector2d d = ( p1 - p0 ) / len, n( -d(1), d(0) );
+
+        // strongest gradient along the normal of each sample, roughly aligned with it
+        int n_samples = int( len ) + 1 + 2 * ext;
+        off.assign( n_samples, 0.0 );
+        mag.assign( n_samples, 0.0 );
+        sgn.assign( n_samples, 0 );
+        for( int i = 0; i < n_samples; i++ )
         {
-            Ptr<ORB> orb = ORB::create( Config::orbNFeatures(), Config::orbScaleFactor(), Config::orbNLevels() );
-            orb->detectAndCompute( img, Mat(), points, pdesc, false);
+            Vector2d base = p0 + double( i - ext ) * d;
+            int best = -1;
+            for( int o = -band; o <= band; o++ )
+            {
+                Vector2d q = base + double(o) * n;
+                int x = int( round( q(0) ) ), y = int( round( q(1) ) );
+                proj_band[o+band] = 0.0;
+                if( x < 0 || y < 0 || x >= cols || y >= rows )
+                    continue;
+                double gx = dx.at<short>(y,x), gy = dy.at<short>(y,x);
+                double proj = gx * n(0) + gy * n(1);
+                if( fabs(proj) < cos_th * sqrt( gx*gx + gy*gy ) )
+                    continue;
+                proj_band[o+band] = proj;
+                if( best < 0 || fabs(proj) > fabs(proj_band[best]) )
+                    best = o + band;
+            }
+            if( best < 0 || proj_band[best] == 0.0 )
+                continue;
+            // sub-pixel peak from the neighbouring responses
+            double o_sub = best - band;
+            if( best > 0 && best < 2*band )
+            {
+                double m0 = fabs( proj_band[best-1] ), m1 = fabs( proj_band[best] ), m2 = fabs( proj_band[best+1] );
+                double den = m0 - 2.0 * m1 + m2;
+                if( den < 0.0 )
+                    o_sub += 0.5 * ( m0 - m2 ) / den;
+            }
+            off[i] = o_sub;
+            mag[i] = fabs( proj_band[best] );
+            sgn[i] = ( proj_band[best] > 0.0 ) ? 1 : -1;
         }
-    }
 
-    // Detect line features
-    lines.clear();
-    if( Config::hasLines() )
-    {
-        if( Config::useEDLines() )
+        // polarity of the edge and support threshold from the samples inside the coarse segment
+        double sum_sgn = 0.0, sum_mag = 0.0;
+        int    n_in = 0;
+        for( int i = ext; i < n_samples - ext; i++ )
+            sum_sgn += sgn[i] * mag[i];
+        int polarity = ( sum_sgn >= 0.0 ) ? 1 : -1;
+        for( int i = ext; i < n_samples - ext; i++ )
         {
-            // EDLines parameters
-            BinaryDescriptor::EDLineParam opts;
-            opts.ksize               = Config::edlKsize();
-            opts.sigma               = Config::edlSigma();
-            opts.gradientThreshold   = Config::edlGradientTh();
-            opts.anchorThreshold     = Config::edlAnchorTh();
-            opts.scanIntervals       = Config::edlScanInterv();
-            opts.minLineLen          = Config::edlMinLineLen();
-            opts.lineFitErrThreshold = Config::edlFitErrTh();
-            BinaryDescriptor::EDLineDetector* edl = new BinaryDescriptor::EDLineDetector(opts);
-            BinaryDescriptor::LineChains lines_;
-            edl->EDline(img,lines_);
-            int idx_aux = 0;
-            for(int i = 0; i < edl->lineEndpoints_.size(); i++)
+            if( sgn[i] == polarity )
             {
-                KeyLine l_;
-                // estimate endpoints from LineChains
-                int s_idx = lines_.sId[i];
-                int e_idx = lines_.sId[i+1] - 1;
-                float sx  = edl->lineEndpoints_[i][0];
-                float sy  = edl->lineEndpoints_[i][1];
-                float ex  = edl->lineEndpoints_[i][2];
-                float ey  = edl->lineEndpoints_[i][3];
-                double line_length = sqrt( double( pow(ex-sx,2) + pow(ey-sy,2) ) );
-                // create keyline
-                if( line_length > min_line_length )
-                {
-                    l_.angle       = edl->lineDirection_[i];
-                    l_.startPointX = sx;    l_.sPointInOctaveX = sx;
-                    l_.startPointY = sy;    l_.sPointInOctaveY = sy;
-                    l_.endPointX   = ex;    l_.ePointInOctaveX = ex;
-                    l_.endPointY   = ey;    l_.ePointInOctaveY = ey;
-                    l_.lineLength  = line_length;
-                    l_.octave      = 0;
-                    l_.class_id    = idx_aux;
-                    l_.numOfPixels = e_idx - s_idx;
-                    l_.response    = line_length / double(max( img_l.cols, img_l.rows ));
-                    lines.push_back(l_);
-                    idx_aux++;
-                }
+                sum_mag += mag[i];
+                n_in++;
             }
-            lbd->compute( img, lines, ldesc);
         }
-        else
+        if( n_in < 3 )
+            continue;
+        double th = 0.5 * sum_mag / double(n_in);
+
+        // supported span around the middle of the segment, bridging gaps up to one coarse pixel
+        auto supported = [&]( int i ){ return sgn[i] == polarity && mag[i] >= th; };
+        int mid = n_samples / 2, i_start = -1, i_end = -1;
+        for( int r = 0; r <= n_samples / 2 && i_start < 0; r++ )
+        {
+            if( mid - r >= 0 && supported( mid - r ) )
+                i_start = mid - r;
+            else if( mid + r < n_samples && supported( mid + r ) )
+                i_start = mid + r;
+        }
+        if( i_start < 0 )
+            continue;
+        i_end = i_start;
+        for( int i = i_start - 1, gap = 0; i >= 0 && gap <= ext; i-- )
+        {
+            if( supported(i) ) { i_start = i; gap = 0; }
+            else gap++;
+        }
+        for( int i = i_end + 1, gap = 0; i < n_samples && gap <= ext; i++ )
+        {
+            if( supported(i) ) { i_end = i; gap = 0; }
+            else gap++;
+        }
+
+        // weighted least squares fit of the normal offset o = a + b t of the edge points
+        double sw = 0.0, st = 0.0, so = 0.0, stt = 0.0, sto = 0.0;
+        int    n_fit = 0;
+        for( int i = i_start; i <= i_end; i++ )
         {
-            Ptr<LSDDetector>        lsd = LSDDetector::createLSDDetector();
-            // lsd parameters
-            LSDDetector::LSDOptions opts;
-            opts.refine       = Config::lsdRefine();
-            opts.scale        = Config::lsdScale();
-            opts.sigma_scale  = Config::lsdSigmaScale();
-            opts.quant        = Config::lsdQuant();
-            opts.ang_th       = Config::lsdAngTh();
-            opts.log_eps      = Config::lsdLogEps();
-            opts.density_th   = Config::lsdDensityTh();
-            opts.n_bins       = Config::lsdNBins();
-            opts.min_length   = min_line_length;
-
-            lsd->detect( img, lines, 1, 1, opts);
-            lbd->compute( img, lines, ldesc);
+            if( !supported(i) )
+                continue;
+            double w = mag[i], t = double( i - ext );
+            sw += w;  st += w * t;  so += w * off[i];  stt += w * t * t;  sto += w * t * off[i];
+            n_fit++;
         }
+        if( n_fit < 3 )
+            continue;
+        double den = sw * stt - st * st;
+        double b = ( fabs(den) > 1e-9 ) ? ( sw * sto - st * so ) / den : 0.0;
+        double a = ( so - b * st ) / sw;
+
+        double t0 = double( i_start - ext ), t1 = double( i_end - ext );
+        Vector2d q0 = p0 + t0 * d + ( a + b * t0 ) * n;
+        Vector2d q1 = p0 + t1 * d + ( a + b * t1 ) * n;
+        q0(0) = std::min( std::max( q0(0), 0.0 ), double( cols - 1 ) );
+        q0(1) = std::min( std::max( q0(1), 0.0 ), double( rows - 1 ) );
+        q1(0) = std::min( std::max( q1(0), 0.0 ), double( cols - 1 ) );
+        q1(1) = std::min( std::max( q1(1), 0.0 ), double( rows - 1 ) );
+        double length = ( q1 - q0 ).norm();
+        if( length <= min_line_length )
+            continue;
+
+        KeyLine kl = l;
+        kl.startPointX = q0(0);    kl.sPointInOctaveX = kl.startPointX;
+        kl.startPointY = q0(1);    kl.sPointInOctaveY = kl.startPointY;
+        kl.endPointX   = q1(0);    kl.ePointInOctaveX = kl.endPointX;
+        kl.endPointY   = q1(1);    kl.ePointInOctaveY = kl.endPointY;
+        kl.lineLength  = length;
+        kl.numOfPixels = LineIterator( pyr.octaves[0], Point2f( kl.startPointX, kl.startPointY ), Point2f( kl.endPointX, kl.endPointY ) ).count;
+        kl.angle       = atan2( ( kl.endPointY - kl.startPointY ), ( kl.endPointX - kl.startPointX ) );
+        kl.class_id    = refined.size();
+        kl.octave      = 0;
+        kl.size        = ( kl.endPointX - kl.startPointX ) * ( kl.endPointY - kl.startPointY );
+        kl.response    = kl.lineLength / max( cols, rows );
+        kl.pt          = Point2f( ( kl.endPointX + kl.startPointX ) / 2, ( kl.endPointY + kl.startPointY ) / 2 );
+        refined.push_back( kl );
     }
+    lines.swap( refined );
 
 }
 
+void StereoFrame::describeLineFeatures( const ImagePyramid &pyr, vector<KeyLine> &lines, Mat &ldesc )
+{
+    // the left and right descriptors are computed together, each with its share of the threads
+    Ptr<BinaryDescriptor> lbd = BinaryDescriptor::createBinaryDescriptor();
+    lbd->setMaxThreads( TaskGraph::threadShare( 2, Config::lrInParallel() ) );
+    lbd->compute( pyr.smoothed, pyr.dx, pyr.dy, lines, ldesc);
+}
+
 void StereoFrame::matchPointFeatures(BFMatcher* bfm, Mat pdesc_1, Mat pdesc_2, vector<vector<DMatch>> &pmatches_12  )
 {
-    bfm->knnMatch( pdesc_1, pdesc_2, pmatches_12, 2);
+    if( Config::useSIMDMatcher() && HammingMatcher::isSupported(pdesc_1) && HammingMatcher::isSupported(pdesc_2) )
+        HammingMatcher::knnMatch( pdesc_1, pdesc_2, pmatches_12, 2);
+    else
+        bfm->knnMatch( pdesc_1, pdesc_2, pmatches_12, 2);
 }
 
 void StereoFrame::matchLineFeatures(Ptr<BinaryDescriptorMatcher> bdm, Mat ldesc_1, Mat ldesc_2, vector<vector<DMatch>> &lmatches_12  )
@@ -600,7 +733,24 @@ void StereoFrame::matchLineFeatures(Ptr<BinaryDescriptorMatcher> bdm, Mat ldesc_
 
 void StereoFrame::matchLineFeaturesBFM(BFMatcher* bfm, Mat ldesc_1, Mat ldesc_2, vector<vector<DMatch>> &lmatches_12  )
 {
-    bfm->knnMatch( ldesc_1, ldesc_2, lmatches_12, 2);
+    if( Config::useSIMDMatcher() && HammingMatcher::isSupported(ldesc_1) && HammingMatcher::isSupported(ldesc_2) )
+        HammingMatcher::knnMatch( ldesc_1, ldesc_2, lmatches_12, 2);
+    else
+        bfm->knnMatch( ldesc_1, ldesc_2, lmatches_12, 2);
+}
+
+void StereoFrame::matchFeaturesBidirectional(BFMatcher* bfm, Mat desc_1, Mat desc_2, vector<vector<DMatch>> &matches_12, vector<vector<DMatch>> &matches_21 )
+{
+    // 12 and 21 matches from a single computation of the distances
+    if( Config::useSIMDMatcher() )
+        HammingMatcher::knnMatchBidirectional( desc_1, desc_2, matches_12, matches_21, 2, Config::lrInParallel() );
+    else
+    {
+        TaskGraph graph;
+        graph.addTask( [&]{ bfm->knnMatch( desc_1, desc_2, matches_12, 2); } );
+        graph.addTask( [&]{ bfm->knnMatch( desc_2, desc_1, matches_21, 2); } );
+        graph.run( Config::lrInParallel() );
+    }
 }
 
 void StereoFrame::pointDescriptorMAD( const vector<vector<DMatch>> matches, double &nn_mad, double &nn12_mad )
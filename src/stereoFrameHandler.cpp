@@ -20,12 +20,19 @@
 *****************************************************************************/
 
 #include <stereoFrameHandler.h>
+#include <hammingMatcher.h>
+#include <featureGrid.h>
 
 namespace StVO{
 
-StereoFrameHandler::StereoFrameHandler( PinholeStereoCamera *cam_ ) : cam(cam_) {}
+static const int OPTIM_MIN_RANGE = 128;   // min. number of matched features per parallel task of the optimizer
 
-StereoFrameHandler::~StereoFrameHandler(){}
+StereoFrameHandler::StereoFrameHandler( PinholeStereoCamera *cam_ ) : cam(cam_), n_skipped_frames(0), n_degraded_frames(0), last_idx(-1), pipe_tasks(NULL) {}
+
+StereoFrameHandler::~StereoFrameHandler()
+{
+    stopPipeline();
+}
 
 void StereoFrameHandler::initialize(const Mat img_l_, const Mat img_r_ , const int idx_)
 {
@@ -34,6 +41,7 @@ void StereoFrameHandler::initialize(const Mat img_l_, const Mat img_r_ , const i
     prev_frame->Tfw = Matrix4d::Identity();
     prev_frame->Tfw_cov = Matrix6d::Identity();
     prev_frame->DT  = Matrix4d::Identity();
+    last_idx = idx_;
     max_idx_pt = prev_frame->stereo_pt.size();  max_idx_pt_prev_kf = max_idx_pt;
     max_idx_ls = prev_frame->stereo_ls.size();  max_idx_ls_prev_kf = max_idx_ls;
 }
@@ -41,11 +49,106 @@ void StereoFrameHandler::initialize(const Mat img_l_, const Mat img_r_ , const i
 void StereoFrameHandler::insertStereoPair(const Mat img_l_, const Mat img_r_ , const int idx_)
 {
     curr_frame = new StereoFrame( img_l_, img_r_, idx_, cam );
+    assignBudget( curr_frame );
     curr_frame->extractStereoFeatures();
     f2fTracking();
 }
 
+bool StereoFrameHandler::insertStereoPairPipelined(const Mat img_l_, const Mat img_r_ , const int idx_)
+{
+    // the features of the new pair are extracted by the workers while the caller tracks older frames
+    if( pipe_tasks == NULL )
+        startPipeline();
+    StereoFrame* frame = new StereoFrame( img_l_, img_r_, idx_, cam );
+    // the budget is fixed at insertion, in frame order: it only reflects the frames tracked so far, i.e. it lags
+    // up to pipeline_depth frames behind the serial case, so that pipelined and serial runs can differ when
+    // budget_control or real_time adapt the budget (assigning it when a worker starts the frame would depend
+    // on the scheduling instead)
+    assignBudget( frame );
+    packaged_task<void()> task( bind( &StereoFrame::extractStereoFeatures, frame ) );
+    pipe_frames.push_back( make_pair( frame, task.get_future() ) );
+    pipe_tasks->push( std::move(task) );
+    // wait for the oldest frame only once the pipeline is full (backpressure)
+    if( (int) pipe_frames.size() < max(1,Config::pipelineDepth()) )
+        return false;
+    return flushStereoPair();
+}
+
+bool StereoFrameHandler::flushStereoPair()
+{
+    // track the oldest pending frame, so that frames are processed in the same order as in the serial case
+    if( pipe_frames.empty() )
+        return false;
+    curr_frame = pipe_frames.front().first;
+    pipe_frames.front().second.get();
+    pipe_frames.pop_front();
+    f2fTracking();
+    return true;
+}
+
+void StereoFrameHandler::assignBudget( StereoFrame* frame )
+{
+    // frames are inserted in order, gaps in their indices are the pairs dropped by the caller
+    frame->budget = budget.current();
+    if( frame->budget.degraded() )
+        n_degraded_frames++;
+    if( last_idx >= 0 )
+        n_skipped_frames += max( 0, frame->frame_idx - last_idx - 1 );
+    last_idx = frame->frame_idx;
+}
+
+void StereoFrameHandler::startPipeline()
+{
+    int n_workers = max(1,Config::pipelineWorkers());
+    pipe_tasks = new BoundedQueue< packaged_task<void()> >( max(1,Config::pipelineDepth()) );
+    for( int i = 0; i < n_workers; i++ )
+        pipe_workers.push_back( thread( &StereoFrameHandler::pipelineWorker, this ) );
+}
+
+void StereoFrameHandler::stopPipeline()
+{
+    if( pipe_tasks == NULL )
+        return;
+    pipe_tasks->close();
+    for( size_t i = 0; i < pipe_workers.size(); i++ )
+        pipe_workers[i].join();
+    pipe_workers.clear();
+    // discard the frames that were never tracked (no worker is running at this point)
+    for( size_t i = 0; i < pipe_frames.size(); i++ )
+        delete pipe_frames[i].first;
+    pipe_frames.clear();
+    delete pipe_tasks;
+    pipe_tasks = NULL;
+}
+
+void StereoFrameHandler::pipelineWorker()
+{
+    packaged_task<void()> task;
+    while( pipe_tasks->pop(task) )
+        task();
+}
+
 void StereoFrameHandler::f2fTracking()
+{
+
+    // points and line segments are tracked as independent tasks
+    FeatureBudget::Clock::time_point t0 = FeatureBudget::Clock::now();
+    TaskGraph graph;
+    graph.addTask( [this]{ f2fTrackingPoints(); } );
+    graph.addTask( [this]{ f2fTrackingLines(); } );
+    graph.run( Config::lrInParallel() );
+
+    // contiguous copy of the matches for the optimizer
+    matched.assign( matched_pt, matched_ls );
+
+    n_inliers_pt = matched_pt.size();
+    n_inliers_ls = matched_ls.size();
+    n_inliers    = n_inliers_pt + n_inliers_ls;
+    curr_frame->timing.tracking = FeatureBudget::elapsedMs( t0 );
+
+}
+
+void StereoFrameHandler::f2fTrackingPoints()
 {
 
     // points f2f tracking
@@ -58,23 +161,20 @@ void StereoFrameHandler::f2fTracking()
         // 12 and 21 matches
         pdesc_l1 = prev_frame->pdesc_l;
         pdesc_l2 = curr_frame->pdesc_l;        
-        if( Config::bestLRMatches() )
+        if( Config::guidedF2F() )
         {
-            if( Config::lrInParallel() )
-            {
-                auto match_l = async( launch::async, &StereoFrame::matchPointFeatures, prev_frame, bfm, pdesc_l1, pdesc_l2, ref(pmatches_12) );
-                auto match_r = async( launch::async, &StereoFrame::matchPointFeatures, prev_frame, bfm, pdesc_l2, pdesc_l1, ref(pmatches_21) );
-                match_l.wait();
-                match_r.wait();
-            }
-            else
-            {
-                bfm->knnMatch( pdesc_l1, pdesc_l2, pmatches_12, 2);
-                bfm->knnMatch( pdesc_l2, pdesc_l1, pmatches_21, 2);
-            }
+            // only the current points around the predicted position of each previous point
+            vector<vector<int>> candidates;
+            guidedPointCandidates( predictMotion(), candidates );
+            HammingMatcher::knnMatchCandidates( pdesc_l1, pdesc_l2, candidates, pmatches_12, pmatches_21, 2 );
+            compactMatches( pmatches_12 );
+        }
+        else if( Config::bestLRMatches() )
+        {
+            prev_frame->matchFeaturesBidirectional( bfm, pdesc_l1, pdesc_l2, pmatches_12, pmatches_21 );
         }
         else
-            bfm->knnMatch( pdesc_l1, pdesc_l2, pmatches_12, 2);
+            prev_frame->matchPointFeatures( bfm, pdesc_l1, pdesc_l2, pmatches_12 );
 
         // sort matches by the distance between the best and second best matches
         double nn12_dist_th = Config::minRatio12P();
@@ -82,7 +182,7 @@ void StereoFrameHandler::f2fTracking()
 
         // resort according to the queryIdx
         sort( pmatches_12.begin(), pmatches_12.end(), sort_descriptor_by_queryIdx() );
-        if( Config::bestLRMatches() )
+        if( Config::bestLRMatches() && !Config::guidedF2F() )
             sort( pmatches_21.begin(), pmatches_21.end(), sort_descriptor_by_queryIdx() );
 
         // bucle around pmatches
@@ -97,13 +197,14 @@ void StereoFrameHandler::f2fTracking()
             else
                 rl_tdx = lr_qdx;
             // check if they are mutual best matches and the minimum distance
-            double dist_nn = pmatches_12[i][0].distance;
-            double dist_12 = pmatches_12[i][0].distance / pmatches_12[i][1].distance;
+            // (a single guided candidate has no rival, so it skips the ratio test)
+            bool ratio_ok  = pmatches_12[i].size() < 2 ||
+                             pmatches_12[i][0].distance / pmatches_12[i][1].distance > nn12_dist_th;
             // check the f2f max disparity condition
             double dispL   = fabsf( curr_frame->stereo_pt[lr_tdx]->pl(0) - prev_frame->stereo_pt[lr_qdx]->pl(0) );
             double dispR   = fabsf( curr_frame->stereo_pt[lr_tdx]->pl(0) - curr_frame->stereo_pt[lr_tdx]->disp
                                     - ( prev_frame->stereo_pt[lr_qdx]->pl(0) - prev_frame->stereo_pt[lr_qdx]->disp ) );
-            if( lr_qdx == rl_tdx  && dist_12 > nn12_dist_th && dispL <= dispTh && dispR <= dispTh )
+            if( lr_qdx == rl_tdx  && ratio_ok && dispL <= dispTh && dispR <= dispTh )
             {
                 PointFeature* point_ = prev_frame->stereo_pt[lr_qdx];
                 point_->pl_obs = curr_frame->stereo_pt[lr_tdx]->pl;
@@ -130,66 +231,71 @@ void StereoFrameHandler::f2fTracking()
 
     }
 
+}
+
+void StereoFrameHandler::f2fTrackingLines()
+{
+
     // line segments f2f tracking
     matched_ls.clear();
     if( Config::hasLines() && !(curr_frame->stereo_ls.size()==0) && !(prev_frame->stereo_ls.size()==0)  )
     {
-        Ptr<BinaryDescriptorMatcher> bdm = BinaryDescriptorMatcher::createBinaryDescriptorMatcher();
         BFMatcher* bfm = new BFMatcher( NORM_HAMMING, false );    // cross-check
         Mat ldesc_l1, ldesc_l2;
         vector<vector<DMatch>> lmatches_12, lmatches_21;
         // 12 and 21 matches
         ldesc_l1 = prev_frame->ldesc_l;
         ldesc_l2 = curr_frame->ldesc_l;
-        if( Config::useBFMLines() )
+        if( Config::guidedF2F() )
         {
-            if( Config::bestLRMatches() )
+            // only the current lines around the predicted position of each previous line
+            vector<vector<int>> candidates;
+            guidedLineCandidates( predictMotion(), candidates );
+            HammingMatcher::knnMatchCandidates( ldesc_l1, ldesc_l2, candidates, lmatches_12, lmatches_21, 2 );
+            compactMatches( lmatches_12 );
+            if( lmatches_12.empty() )
+                return;
+        }
+        else if( Config::bestLRMatches() )
+        {
+            if( Config::useBFMLines() )
+                prev_frame->matchFeaturesBidirectional( bfm, ldesc_l1, ldesc_l2, lmatches_12, lmatches_21 );
+            else
             {
-                if( Config::lrInParallel() )
-                {
-                    auto match_l = async( launch::async, &StereoFrame::matchLineFeaturesBFM, prev_frame, bfm, ldesc_l1, ldesc_l2, ref(lmatches_12) );
-                    auto match_r = async( launch::async, &StereoFrame::matchLineFeaturesBFM, prev_frame, bfm, ldesc_l2, ldesc_l1, ref(lmatches_21) );
-                    match_l.wait();
-                    match_r.wait();
-                }
-                else
-                {
-                    bfm->knnMatch( ldesc_l1,ldesc_l2, lmatches_12, 2);
-                    bfm->knnMatch( ldesc_l2,ldesc_l1, lmatches_21, 2);
-                }
+                // queries against the descriptor indices built during the stereo matching of each frame
+                int n_threads = TaskGraph::threadShare( 2, Config::lrInParallel() );
+                TaskGraph graph;
+                graph.addTask( [&]{ curr_frame->ldesc_index.knnMatch( ldesc_l1, lmatches_12, 2, n_threads ); } );
+                graph.addTask( [&]{ prev_frame->ldesc_index.knnMatch( ldesc_l2, lmatches_21, 2, n_threads ); } );
+                graph.run( Config::lrInParallel() );
             }
-            else
-                bfm->knnMatch( ldesc_l1,ldesc_l2, lmatches_12, 2);
         }
+        else if( Config::useBFMLines() )
+            prev_frame->matchLineFeaturesBFM( bfm, ldesc_l1, ldesc_l2, lmatches_12 );
         else
+            curr_frame->ldesc_index.knnMatch( ldesc_l1, lmatches_12, 2, TaskGraph::threadShare( 2, Config::lrInParallel() ) );
+
+        // sort matches by the distance between the best and second best matches (only the
+        // features with two candidates are employed, the guided ones may have a single one)
+        double nn_dist_th, nn12_dist_th = 0.0;
+        if( Config::guidedF2F() )
         {
-            if( Config::bestLRMatches() )
+            vector<vector<DMatch>> lmatches_12_;
+            for( int i = 0; i < lmatches_12.size(); i++ )
             {
-                if( Config::lrInParallel() )
-                {
-                    auto match_l = async( launch::async, &StereoFrame::matchLineFeatures, prev_frame, bdm, ldesc_l1, ldesc_l2, ref(lmatches_12) );
-                    auto match_r = async( launch::async, &StereoFrame::matchLineFeatures, prev_frame, bdm, ldesc_l2, ldesc_l1, ref(lmatches_21) );
-                    match_l.wait();
-                    match_r.wait();
-                }
-                else
-                {
-                    bdm->knnMatch( ldesc_l1, ldesc_l2, lmatches_12, 2);
-                    bdm->knnMatch( ldesc_l2, ldesc_l1, lmatches_21, 2);
-                }
+                if( lmatches_12[i].size() > 1 )
+                    lmatches_12_.push_back( lmatches_12[i] );
             }
-            else
-                bdm->knnMatch( ldesc_l1, ldesc_l2, lmatches_12, 2);
+            if( !lmatches_12_.empty() )
+                curr_frame->lineDescriptorMAD(lmatches_12_,nn_dist_th, nn12_dist_th);
         }
-
-        // sort matches by the distance between the best and second best matches
-        double nn_dist_th, nn12_dist_th;
-        curr_frame->lineDescriptorMAD(lmatches_12,nn_dist_th, nn12_dist_th);
+        else
+            curr_frame->lineDescriptorMAD(lmatches_12,nn_dist_th, nn12_dist_th);
         nn12_dist_th  = nn12_dist_th * Config::descThL();
 
         // resort according to the queryIdx
         sort( lmatches_12.begin(), lmatches_12.end(), sort_descriptor_by_queryIdx() );
-        if( Config::bestLRMatches() )
+        if( Config::bestLRMatches() && !Config::guidedF2F() )
             sort( lmatches_21.begin(), lmatches_21.end(), sort_descriptor_by_queryIdx() );
         // bucle around pmatches
         for( int i = 0; i < lmatches_12.size(); i++ )
@@ -203,14 +309,16 @@ void StereoFrameHandler::f2fTracking()
             else
                 rl_tdx = lr_qdx;
             // check if they are mutual best matches and the minimum distance
-            double dist_12 = lmatches_12[i][1].distance - lmatches_12[i][0].distance;
+            // (a single guided candidate has no rival, so it skips the test)
+            bool dist_ok = lmatches_12[i].size() < 2 ||
+                           lmatches_12[i][1].distance - lmatches_12[i][0].distance > nn12_dist_th;
 
             // f2f angle diff and flow
             double a1 = prev_frame->stereo_ls[lr_qdx]->angle;
             double a2 = curr_frame->stereo_ls[lr_tdx]->angle;
             Vector2d x1 = (prev_frame->stereo_ls[lr_qdx]->spl + prev_frame->stereo_ls[lr_qdx]->epl);
             Vector2d x2 = (curr_frame->stereo_ls[lr_tdx]->spl + curr_frame->stereo_ls[lr_tdx]->epl);
-            if( lr_qdx == rl_tdx  && dist_12 > nn12_dist_th && angDiff(a1,a2) < Config::maxF2FAngDiff() && (x2-x1).norm() < 2.0 * Config::f2fFlowTh() )
+            if( lr_qdx == rl_tdx  && dist_ok && angDiff(a1,a2) < Config::maxF2FAngDiff() && (x2-x1).norm() < 2.0 * Config::f2fFlowTh() )
             {
                 LineFeature* line_ = prev_frame->stereo_ls[lr_qdx];
 
@@ -242,16 +350,71 @@ void StereoFrameHandler::f2fTracking()
 
     }
 
-    n_inliers_pt = matched_pt.size();
-    n_inliers_ls = matched_ls.size();
-    n_inliers    = n_inliers_pt + n_inliers_ls;
+}
+
+Matrix4d StereoFrameHandler::predictMotion()
+{
+    // transformation of the points from the previous to the current frame, from the motion prior
+    // if available or else from the last estimated motion (constant velocity model)
+    if( Config::motionPrior() )
+        return inverse_se3( expmap_se3( prior_inc ) );
+    return inverse_se3( prev_frame->DT );
+}
+
+void StereoFrameHandler::guidedPointCandidates( const Matrix4d &T, vector<vector<int>> &candidates )
+{
+    double win = Config::f2fGuidedWin();
+    FeatureGrid grid( cam->getWidth(), cam->getHeight(), win );
+    for( int j = 0; j < curr_frame->stereo_pt.size(); j++ )
+        grid.insert( j, curr_frame->stereo_pt[j]->pl );
+
+    candidates.assign( prev_frame->stereo_pt.size(), vector<int>() );
+    for( int i = 0; i < prev_frame->stereo_pt.size(); i++ )
+    {
+        Vector3d P = T.block(0,0,3,3) * prev_frame->stereo_pt[i]->P + T.col(3).head(3);
+        if( P(2) > 0.0 )
+            grid.query( cam->projection(P), win, candidates[i] );
+    }
+}
+
+void StereoFrameHandler::guidedLineCandidates( const Matrix4d &T, vector<vector<int>> &candidates )
+{
+    // the lines are searched by the midpoint of their endpoints
+    double win = Config::f2fGuidedWin();
+    FeatureGrid grid( cam->getWidth(), cam->getHeight(), win );
+    for( int j = 0; j < curr_frame->stereo_ls.size(); j++ )
+        grid.insert( j, 0.5 * ( curr_frame->stereo_ls[j]->spl + curr_frame->stereo_ls[j]->epl ) );
+
+    candidates.assign( prev_frame->stereo_ls.size(), vector<int>() );
+    for( int i = 0; i < prev_frame->stereo_ls.size(); i++ )
+    {
+        Vector3d sP = T.block(0,0,3,3) * prev_frame->stereo_ls[i]->sP + T.col(3).head(3);
+        Vector3d eP = T.block(0,0,3,3) * prev_frame->stereo_ls[i]->eP + T.col(3).head(3);
+        if( sP(2) > 0.0 && eP(2) > 0.0 )
+            grid.query( 0.5 * ( cam->projection(sP) + cam->projection(eP) ), win, candidates[i] );
+    }
+}
 
+void StereoFrameHandler::compactMatches( vector<vector<DMatch>> &matches )
+{
+    // drop the features without candidates (those with a single one skip the ratio tests)
+    int n = 0;
+    for( int i = 0; i < matches.size(); i++ )
+    {
+        if( matches[i].empty() )
+            continue;
+        matches[n++].swap( matches[i] );
+    }
+    matches.resize( n );
 }
 
 void StereoFrameHandler::updateFrame()
 {
+    // the stage times of the frame drive the budget of the next ones
+    budget.update( curr_frame->timing, n_inliers_pt, n_inliers_ls );
     matched_pt.clear();
     matched_ls.clear();
+    matched.clear();
     delete prev_frame;
     prev_frame = curr_frame;
     curr_frame = NULL;
@@ -261,6 +424,7 @@ void StereoFrameHandler::optimizePose()
 {
 
     // definitions
+    FeatureBudget::Clock::time_point t0 = FeatureBudget::Clock::now();
     Matrix6d DT_cov;
     Matrix4d DT, DT_;
     Vector6d DT_cov_eig;
@@ -273,17 +437,11 @@ void StereoFrameHandler::optimizePose()
     // solver
     if( n_inliers > Config::minFeatures() )
     {
-        // optimize
-        DT_ = DT;
-        gaussNewtonOptimization(DT_,DT_cov,err,Config::maxIters());
-        // remove outliers (implement some logic based on the covariance's eigenvalues and optim error)
-        if( is_finite(DT_) )
+        if( Config::irlsOutliers() )
         {
-            removeOutliers(DT_);
-            // refine without outliers
-            if( n_inliers > Config::minFeatures() )
-                gaussNewtonOptimization(DT,DT_cov,err,Config::maxItersRef());
-            else
+            // single pass: the outliers are rejected inside the iterations, which continue from the current estimate
+            poseOptimization(DT,DT_cov,err,Config::maxIters()+Config::maxItersRef(),true);
+            if( !is_finite(DT) || n_inliers <= Config::minFeatures() )
             {
                 DT     = Matrix4d::Identity();
                 DT_cov = Matrix6d::Zero();
@@ -291,8 +449,27 @@ void StereoFrameHandler::optimizePose()
         }
         else
         {
-            DT     = Matrix4d::Identity();
-            DT_cov = Matrix6d::Zero();
+            // optimize
+            DT_ = DT;
+            poseOptimization(DT_,DT_cov,err,Config::maxIters());
+            // remove outliers (implement some logic based on the covariance's eigenvalues and optim error)
+            if( is_finite(DT_) )
+            {
+                removeOutliers(DT_);
+                // refine without outliers
+                if( n_inliers > Config::minFeatures() )
+                    poseOptimization(DT,DT_cov,err,Config::maxItersRef());
+                else
+                {
+                    DT     = Matrix4d::Identity();
+                    DT_cov = Matrix6d::Zero();
+                }
+            }
+            else
+            {
+                DT     = Matrix4d::Identity();
+                DT_cov = Matrix6d::Zero();
+            }
         }
     }
     else
@@ -301,6 +478,9 @@ void StereoFrameHandler::optimizePose()
         DT_cov = Matrix6d::Zero();
     }
 
+    // update the inlier flags of the matched features
+    matched.writeInliers();
+
     // set estimated pose
     if( is_finite(DT) )
     {
@@ -323,12 +503,15 @@ void StereoFrameHandler::optimizePose()
         curr_frame->err_norm   = -1.0;
     }
 
+    curr_frame->timing.optimization = FeatureBudget::elapsedMs( t0 );
+
 }
 
 void StereoFrameHandler::optimizePose(Matrix4d DT_ini)
 {
 
     // definitions
+    FeatureBudget::Clock::time_point t0 = FeatureBudget::Clock::now();
     Matrix6d DT_cov;
     Matrix4d DT, DT_;
     double   err;
@@ -340,17 +523,11 @@ void StereoFrameHandler::optimizePose(Matrix4d DT_ini)
     // Gauss-Newton solver
     if( n_inliers > Config::minFeatures() )
     {
-        // optimize
-        DT_ = DT;
-        gaussNewtonOptimization(DT_,DT_cov,err,Config::maxIters());
-        // remove outliers (implement some logic based on the covariance's eigenvalues and optim error)
-        if( is_finite(DT_) )
+        if( Config::irlsOutliers() )
         {
-            removeOutliers(DT_);
-            // refine without outliers
-            if( n_inliers > Config::minFeatures() )
-                gaussNewtonOptimization(DT,DT_cov,err,Config::maxItersRef());
-            else
+            // single pass: the outliers are rejected inside the iterations, which continue from the current estimate
+            poseOptimization(DT,DT_cov,err,Config::maxIters()+Config::maxItersRef(),true);
+            if( !is_finite(DT) || n_inliers <= Config::minFeatures() )
             {
                 DT     = Matrix4d::Identity();
                 DT_cov = Matrix6d::Zero();
@@ -358,8 +535,27 @@ void StereoFrameHandler::optimizePose(Matrix4d DT_ini)
         }
         else
         {
-            DT     = Matrix4d::Identity();
-            DT_cov = Matrix6d::Zero();
+            // optimize
+            DT_ = DT;
+            poseOptimization(DT_,DT_cov,err,Config::maxIters());
+            // remove outliers (implement some logic based on the covariance's eigenvalues and optim error)
+            if( is_finite(DT_) )
+            {
+                removeOutliers(DT_);
+                // refine without outliers
+                if( n_inliers > Config::minFeatures() )
+                    poseOptimization(DT,DT_cov,err,Config::maxItersRef());
+                else
+                {
+                    DT     = Matrix4d::Identity();
+                    DT_cov = Matrix6d::Zero();
+                }
+            }
+            else
+            {
+                DT     = Matrix4d::Identity();
+                DT_cov = Matrix6d::Zero();
+            }
         }
     }
     else
@@ -368,6 +564,9 @@ void StereoFrameHandler::optimizePose(Matrix4d DT_ini)
         DT_cov = Matrix6d::Zero();
     }
 
+    // update the inlier flags of the matched features
+    matched.writeInliers();
+
     // set estimated pose
     if( is_finite(DT) && err < Config::maxOptimError() )
     {
@@ -388,22 +587,34 @@ void StereoFrameHandler::optimizePose(Matrix4d DT_ini)
         curr_frame->err_norm   = -1.0;
     }
 
+    curr_frame->timing.optimization = FeatureBudget::elapsedMs( t0 );
+
 }
 
-void StereoFrameHandler::gaussNewtonOptimization(Matrix4d &DT, Matrix6d &DT_cov, double &err_, int max_iters)
+void StereoFrameHandler::poseOptimization(Matrix4d &DT, Matrix6d &DT_cov, double &err_, int max_iters, bool reject_outliers)
+{
+    if( Config::useLevMarquardt() )
+        levenbergMarquardtOptimization( DT, DT_cov, err_, max_iters, reject_outliers );
+    else
+        gaussNewtonOptimization( DT, DT_cov, err_, max_iters, reject_outliers );
+}
+
+void StereoFrameHandler::gaussNewtonOptimization(Matrix4d &DT, Matrix6d &DT_cov, double &err_, int max_iters, bool reject_outliers)
 {
     Matrix6d H;
     Vector6d g, DT_inc;
     double err, err_prev = 999999999.9;
+    // select the specialized hessian and gradient estimation once for all iterations
+    OptimizeFunctions optimizeFunctions = selectOptimizeFunctions();
     for( int iters = 0; iters < max_iters; iters++)
     {
-        // estimate hessian and gradient (select)
-        if( Config::useUncertainty() )
-            optimizeFunctions_uncweighted( DT, H, g, err );
-        else
-            optimizeFunctions_nonweighted( DT, H, g, err );
+        // estimate hessian and gradient
+        (this->*optimizeFunctions)( DT, H, g, err );
+        // reject the outliers with the residuals of this evaluation, excluded from the next one (the residuals
+        // of the initial estimate are not trusted)
+        bool inliers_changed = reject_outliers && iters > 0 && updateInliers() > 0;
         // if the difference is very small stop
-        if( ( abs(err-err_prev) < Config::minErrorChange() ) || ( err < Config::minError()) )
+        if( !inliers_changed && ( ( abs(err-err_prev) < Config::minErrorChange() ) || ( err < Config::minError()) ) )
             break;
         // update step
         if( Config::motionPrior() )
@@ -431,30 +642,140 @@ void StereoFrameHandler::gaussNewtonOptimization(Matrix4d &DT, Matrix6d &DT_cov,
     err_   = err;
 }
 
+void StereoFrameHandler::levenbergMarquardtOptimization(Matrix4d &DT, Matrix6d &DT_cov, double &err_, int max_iters, bool reject_outliers)
+{
+    Matrix6d H, H_new, H_lm;
+    Vector6d g, g_new, g_lm, DT_inc, DT_inc_prev = Vector6d::Zero();
+    Matrix4d DT_new;
+    double err, err_new;
+    double lambda = Config::lambdaLM();
+    // per-feature state (residuals and line inliers) of the current estimate, restored when a step is rejected
+    AlignedVectord pt_res, ls_res;
+    vector<char> ls_inlier;
+    Matrix6d prior_cov_inv;
+    if( Config::motionPrior() )
+        prior_cov_inv = prior_cov.inverse();
+    // select the specialized hessian and gradient estimation once for all iterations
+    OptimizeFunctions optimizeFunctions = selectOptimizeFunctions();
+    (this->*optimizeFunctions)( DT, H, g, err );
+    for( int iters = 0; iters < max_iters; iters++)
+    {
+        // stop at a stationary point or if the error is already very small
+        if( g.lpNorm<Infinity>() < Config::minGradNorm() || err < Config::minError() )
+            break;
+        // damped step (the damping is scaled with the diagonal of the hessian)
+        H_lm = H;
+        H_lm.diagonal() *= ( 1.0 + lambda );
+        g_lm = g;
+        if( Config::motionPrior() )
+        {
+            H_lm += prior_cov_inv;
+            g_lm += prior_cov_inv * ( DT_inc_prev - prior_inc );
+        }
+        LDLT<Matrix6d> solver(H_lm);
+        DT_inc = solver.solve(g_lm);
+        DT_new << DT * inverse_se3( expmap_se3(DT_inc) );
+        // evaluate the step, and accept it only if it decreases the error
+        pt_res    = matched.pt_res;
+        ls_res    = matched.ls_res;
+        ls_inlier = matched.ls_inlier;
+        (this->*optimizeFunctions)( DT_new, H_new, g_new, err_new );
+        if( err_new < err )
+        {
+            bool converged = ( err - err_new < Config::minErrorChange() ) ||
+                             ( DT_inc.norm() < Config::minRelStep() * ( logmap_se3(DT).norm() + Config::minRelStep() ) );
+            DT  = DT_new;
+            H   = H_new;
+            g   = g_new;
+            err = err_new;
+            DT_inc_prev = DT_inc;
+            lambda /= Config::lambdaK();
+            // reject the outliers with the residuals of the new estimate, and re-evaluate it so that its
+            // error stays comparable with the next steps
+            if( reject_outliers && updateInliers() > 0 )
+            {
+                (this->*optimizeFunctions)( DT, H, g, err );
+                converged = false;
+            }
+            if( converged )
+                break;
+        }
+        else
+        {
+            // rejected step: keep the hessian, gradient, error and per-feature state of the current estimate
+            matched.pt_res.swap( pt_res );
+            matched.ls_res.swap( ls_res );
+            matched.ls_inlier.swap( ls_inlier );
+            lambda *= Config::lambdaK();
+            if( !std::isfinite(lambda) || DT_inc.norm() < numeric_limits<double>::epsilon() )
+                break;
+        }
+    }
+    DT_cov = H.inverse();
+    err_   = err;
+}
+
+int StereoFrameHandler::updateInliers()
+{
+
+    // residuals computed in the last evaluation of the cost (the outliers keep the one they were rejected with,
+    // so that the MAD is estimated over all the matches and the threshold does not shrink as the tails are trimmed)
+    vector<double> res_p( matched.pt_res.begin(), matched.pt_res.end() );
+    vector<double> res_l( matched.ls_res.begin(), matched.ls_res.end() );
+
+    // estimate mad standard deviation
+    double inlier_th_p =  Config::inlierK() * vector_stdv_mad( res_p );
+    double inlier_th_l =  Config::inlierK() * vector_stdv_mad( res_l );
+
+    // filter outliers
+    int n_outliers = 0;
+    for( int i = 0; i < matched.nPoints(); i++ )
+    {
+        if( matched.pt_inlier[i] && matched.pt_res[i] > inlier_th_p )
+        {
+            matched.pt_inlier[i] = false;
+            n_inliers--;
+            n_inliers_pt--;
+            n_outliers++;
+        }
+    }
+    for( int i = 0; i < matched.nLines(); i++ )
+    {
+        if( matched.ls_inlier[i] && matched.ls_res[i] > inlier_th_l )
+        {
+            matched.ls_inlier[i] = false;
+            n_inliers--;
+            n_inliers_ls--;
+            n_outliers++;
+        }
+    }
+    return n_outliers;
+
+}
+
 void StereoFrameHandler::removeOutliers(Matrix4d DT)
 {
 
     vector<double> res_p, res_l;
 
     // point features
-    int iter = 0;
-    for( list<PointFeature*>::iterator it = matched_pt.begin(); it!=matched_pt.end(); it++, iter++)
+    for( int i = 0; i < matched.nPoints(); i++ )
     {
         // projection error
-        Vector3d P_ = DT.block(0,0,3,3) * (*it)->P + DT.col(3).head(3);
+        Vector3d P_ = DT.block(0,0,3,3) * Vector3d( matched.pt_X[i], matched.pt_Y[i], matched.pt_Z[i] ) + DT.col(3).head(3);
         Vector2d pl_proj = cam->projection( P_ );
-        res_p.push_back( ( pl_proj - (*it)->pl_obs ).norm() );
+        res_p.push_back( ( pl_proj - Vector2d( matched.pt_u_obs[i], matched.pt_v_obs[i] ) ).norm() );
     }
 
     // line segment features
-    for( list<LineFeature*>::iterator it = matched_ls.begin(); it!=matched_ls.end(); it++, iter++)
+    for( int i = 0; i < matched.nLines(); i++ )
     {
         // projection error
-        Vector3d sP_ = DT.block(0,0,3,3) * (*it)->sP + DT.col(3).head(3);
-        Vector3d eP_ = DT.block(0,0,3,3) * (*it)->eP + DT.col(3).head(3);
+        Vector3d sP_ = DT.block(0,0,3,3) * Vector3d( matched.ls_sX[i], matched.ls_sY[i], matched.ls_sZ[i] ) + DT.col(3).head(3);
+        Vector3d eP_ = DT.block(0,0,3,3) * Vector3d( matched.ls_eX[i], matched.ls_eY[i], matched.ls_eZ[i] ) + DT.col(3).head(3);
         Vector2d spl_proj = cam->projection( sP_ );
         Vector2d epl_proj = cam->projection( eP_ );
-        Vector3d l_obs    = (*it)->le_obs;
+        Vector3d l_obs    = Vector3d( matched.ls_lx[i], matched.ls_ly[i], matched.ls_lz[i] );
         Vector2d err_li;
         err_li(0) = l_obs(0) * spl_proj(0) + l_obs(1) * spl_proj(1) + l_obs(2);
         err_li(1) = l_obs(0) * epl_proj(0) + l_obs(1) * epl_proj(1) + l_obs(2);
@@ -466,22 +787,20 @@ void StereoFrameHandler::removeOutliers(Matrix4d DT)
     double inlier_th_l =  Config::inlierK() * vector_stdv_mad( res_l );
 
     // filter outliers
-    iter = 0;
-    for( list<PointFeature*>::iterator it = matched_pt.begin(); it!=matched_pt.end(); it++, iter++)
+    for( int i = 0; i < matched.nPoints(); i++ )
     {
-        if( res_p[iter] > inlier_th_p )
+        if( res_p[i] > inlier_th_p )
         {
-            (*it)->inlier = false;
+            matched.pt_inlier[i] = false;
             n_inliers--;
             n_inliers_pt--;
         }
     }
-    iter = 0;
-    for( list<LineFeature*>::iterator it = matched_ls.begin(); it!=matched_ls.end(); it++, iter++)
+    for( int i = 0; i < matched.nLines(); i++ )
     {
-        if( res_l[iter] > inlier_th_l )
+        if( res_l[i] > inlier_th_l )
         {
-            (*it)->inlier = false;
+            matched.ls_inlier[i] = false;
             n_inliers--;
             n_inliers_ls--;
         }
@@ -489,35 +808,137 @@ void StereoFrameHandler::removeOutliers(Matrix4d DT)
 
 }
 
-void StereoFrameHandler::optimizeFunctions_nonweighted(Matrix4d DT, Matrix6d &H, Vector6d &g, double &e )
+StereoFrameHandler::OptimizeFunctions StereoFrameHandler::selectOptimizeFunctions() const
 {
+    // the scaling between points and lines only applies when both kinds of features are employed
+    bool robust = Config::robustCost();
+    bool scale  = Config::scalePointsLines() && Config::hasPoints() && Config::hasLines();
+    if( Config::useUncertainty() )
+    {
+        if( robust )
+            return scale ? &StereoFrameHandler::optimizeFunctions_uncweighted< CostPolicy<true,true> >
+                         : &StereoFrameHandler::optimizeFunctions_uncweighted< CostPolicy<true,false> >;
+        else
+            return scale ? &StereoFrameHandler::optimizeFunctions_uncweighted< CostPolicy<false,true> >
+                         : &StereoFrameHandler::optimizeFunctions_uncweighted< CostPolicy<false,false> >;
+    }
+    else
+    {
+        if( robust )
+            return scale ? &StereoFrameHandler::optimizeFunctions_nonweighted< CostPolicy<true,true> >
+                         : &StereoFrameHandler::optimizeFunctions_nonweighted< CostPolicy<true,false> >;
+        else
+            return scale ? &StereoFrameHandler::optimizeFunctions_nonweighted< CostPolicy<false,true> >
+                         : &StereoFrameHandler::optimizeFunctions_nonweighted< CostPolicy<false,false> >;
+    }
+}
+
+template<class P>
+void StereoFrameHandler::optimizeFunctions_nonweighted(const Matrix4d &DT, Matrix6d &H, Vector6d &g, double &e )
+{
+    reduceCost<P>( DT, &StereoFrameHandler::pointCost_nonweighted<P>, &StereoFrameHandler::lineCost_nonweighted<P>, H, g, e );
+}
 
-    // define hessians, gradients, and residuals
-    Matrix6d H_l, H_p;
-    Vector6d g_l, g_p;
-    double   e_l = 0.0, e_p = 0.0, S_l, S_p;
-    H   = Matrix6d::Zero(); H_l = H; H_p = H;
-    g   = Vector6d::Zero(); g_l = g; g_p = g;
-    e   = 0.0;
+template<class P>
+void StereoFrameHandler::optimizeFunctions_uncweighted(const Matrix4d &DT, Matrix6d &H, Vector6d &g, double &e )
+{
+    reduceCost<P>( DT, &StereoFrameHandler::pointCost_uncweighted<P>, &StereoFrameHandler::lineCost_uncweighted<P>, H, g, e );
+}
 
-    // point features
-    int N_p = 0;
-    vector<double> r_p;
-    for( list<PointFeature*>::iterator it = matched_pt.begin(); it!=matched_pt.end(); it++)
+template<class P>
+void StereoFrameHandler::reduceCost(const Matrix4d &DT, CostKernel point_kernel, CostKernel line_kernel, Matrix6d &H, Vector6d &g, double &e )
+{
+
+    // the features are split in contiguous ranges, each with its own accumulator, which are
+    // merged in range order so that the result does not depend on the scheduling of the tasks
+    int n_p  = matched.nPoints();
+    int n_l  = matched.nLines();
+    int n_rp = max( 1, min( Config::numThreads(), n_p / OPTIM_MIN_RANGE ) );
+    int n_rl = max( 1, min( Config::numThreads(), n_l / OPTIM_MIN_RANGE ) );
+    vector< CostAccumulator, aligned_allocator<CostAccumulator> > acc_p(n_rp), acc_l(n_rl);
+    if( n_rp == 1 && n_rl == 1 )
+    {
+        (this->*point_kernel)( DT, 0, n_p, acc_p[0] );
+        (this->*line_kernel)( DT, 0, n_l, acc_l[0] );
+    }
+    else
+    {
+        TaskGraph graph;
+        for( int r = 0; r < n_rp; r++ )
+        {
+            int i0 = ( n_p * r ) / n_rp;
+            int i1 = ( n_p * (r+1) ) / n_rp;
+            graph.addTask( [&,r,i0,i1]{ (this->*point_kernel)( DT, i0, i1, acc_p[r] ); } );
+        }
+        for( int r = 0; r < n_rl; r++ )
+        {
+            int i0 = ( n_l * r ) / n_rl;
+            int i1 = ( n_l * (r+1) ) / n_rl;
+            graph.addTask( [&,r,i0,i1]{ (this->*line_kernel)( DT, i0, i1, acc_l[r] ); } );
+        }
+        graph.run( Config::lrInParallel() );
+        for( int r = 1; r < n_rp; r++ )
+            acc_p[0].add( acc_p[r] );
+        for( int r = 1; r < n_rl; r++ )
+            acc_l[0].add( acc_l[r] );
+    }
+    const CostAccumulator &pt = acc_p[0];
+    const CostAccumulator &ls = acc_l[0];
+
+    // sum H, g and err from both points and lines
+    double S_p = 0.0, S_l = 0.0;
+    if( P::scale )
+    {
+        S_p = vector_stdv_mad(pt.r);
+        S_l = vector_stdv_mad(ls.r);
+    }
+    const double homog_th = Config::homogTh();
+    if( P::scale && S_l > homog_th && S_p > homog_th )
+    {
+        double S_l_inv = 1.0 / S_l;
+        double S_p_inv = 1.0 / S_p;
+        double S_l_ = (S_p_inv+S_l_inv) / S_p_inv;
+        double S_p_ = (S_p_inv+S_l_inv) / S_l_inv;
+        H = pt.H * S_p_ + ls.H * S_l_;
+        g = pt.g * S_p_ + ls.g * S_l_;
+        e = pt.e * S_p_ + ls.e * S_l_;
+    }
+    else
+    {
+        H = pt.H + ls.H;
+        g = pt.g + ls.g;
+        e = pt.e + ls.e;
+    }
+
+    // normalize error
+    e /= (ls.N+pt.N);
+
+}
+
+template<class P>
+void StereoFrameHandler::pointCost_nonweighted(const Matrix4d &DT, int i0, int i1, CostAccumulator &acc )
+{
+
+    // assign cam parameters and thresholds (read once, outside the feature loop)
+    const double f        = cam->getFx();
+    const double homog_th = Config::homogTh();
+
+    for( int i = i0; i < i1; i++ )
     {
-        if( (*it)->inlier )
+        if( matched.pt_inlier[i] )
         {
-            Vector3d P_ = DT.block(0,0,3,3) * (*it)->P + DT.col(3).head(3);
+            Vector3d P_ = DT.block(0,0,3,3) * Vector3d( matched.pt_X[i], matched.pt_Y[i], matched.pt_Z[i] ) + DT.col(3).head(3);
             Vector2d pl_proj = cam->projection( P_ );
             // projection error
-            Vector2d err_i    = pl_proj - (*it)->pl_obs;
+            Vector2d err_i    = pl_proj - Vector2d( matched.pt_u_obs[i], matched.pt_v_obs[i] );
             double err_i_norm = err_i.norm();
+            matched.pt_res[i] = err_i_norm;
             // estimate variables for J, H, and g
             double gx   = P_(0);
             double gy   = P_(1);
             double gz   = P_(2);
             double gz2  = gz*gz;
-            double fgz2 = cam->getFx() / std::max(Config::homogTh(),gz2);
+            double fgz2 = f / std::max(homog_th,gz2);
             double dx   = err_i(0);
             double dy   = err_i(1);
             // jacobian
@@ -528,47 +949,53 @@ void StereoFrameHandler::optimizeFunctions_nonweighted(Matrix4d DT, Matrix6d &H,
                      - fgz2 * ( gx*gy*dx + gy*gy*dy + gz*gz*dy ),
                      + fgz2 * ( gx*gx*dx + gz*gz*dx + gx*gy*dy ),
                      + fgz2 * ( gx*gz*dy - gy*gz*dx );
-            J_aux = J_aux / std::max(Config::homogTh(),err_i_norm);
+            J_aux = J_aux / std::max(homog_th,err_i_norm);
             // if employing robust cost function
             double w = 1.0;
-            if( Config::robustCost() )
+            if( P::robust )
                 w = 1.0 / ( 1.0 + err_i_norm * err_i_norm );
             // update hessian, gradient, and error
-            H_p += J_aux * J_aux.transpose() * w;
-            g_p += J_aux * err_i_norm * w;
-            e_p += err_i_norm * err_i_norm * w;
-            N_p++;
-            if( Config::scalePointsLines() )
-                r_p.push_back( err_i_norm * err_i_norm * w );
+            acc.H += J_aux * J_aux.transpose() * w;
+            acc.g += J_aux * err_i_norm * w;
+            acc.e += err_i_norm * err_i_norm * w;
+            acc.N++;
+            if( P::scale )
+                acc.r.push_back( err_i_norm * err_i_norm * w );
         }
     }
-    if( Config::scalePointsLines() )
-        S_p = vector_stdv_mad(r_p);
 
-    // line segment features
-    int N_l = 0;
-    vector<double> r_l;
-    for( list<LineFeature*>::iterator it = matched_ls.begin(); it!=matched_ls.end(); it++)
+}
+
+template<class P>
+void StereoFrameHandler::lineCost_nonweighted(const Matrix4d &DT, int i0, int i1, CostAccumulator &acc )
+{
+
+    // assign cam parameters and thresholds (read once, outside the feature loop)
+    const double f        = cam->getFx();
+    const double homog_th = Config::homogTh();
+
+    for( int i = i0; i < i1; i++ )
     {
-        if( (*it)->inlier )
+        if( matched.ls_inlier[i] )
         {
-            Vector3d sP_ = DT.block(0,0,3,3) * (*it)->sP + DT.col(3).head(3);
+            Vector3d sP_ = DT.block(0,0,3,3) * Vector3d( matched.ls_sX[i], matched.ls_sY[i], matched.ls_sZ[i] ) + DT.col(3).head(3);
             Vector2d spl_proj = cam->projection( sP_ );
-            Vector3d eP_ = DT.block(0,0,3,3) * (*it)->eP + DT.col(3).head(3);
+            Vector3d eP_ = DT.block(0,0,3,3) * Vector3d( matched.ls_eX[i], matched.ls_eY[i], matched.ls_eZ[i] ) + DT.col(3).head(3);
             Vector2d epl_proj = cam->projection( eP_ );
-            Vector3d l_obs = (*it)->le_obs;
+            Vector3d l_obs = Vector3d( matched.ls_lx[i], matched.ls_ly[i], matched.ls_lz[i] );
             // projection error
             Vector2d err_i;
             err_i(0) = l_obs(0) * spl_proj(0) + l_obs(1) * spl_proj(1) + l_obs(2);
             err_i(1) = l_obs(0) * epl_proj(0) + l_obs(1) * epl_proj(1) + l_obs(2);
             double err_i_norm = err_i.norm();
+            matched.ls_res[i] = err_i_norm;
             // estimate variables for J, H, and g
             // -- start point
             double gx   = sP_(0);
             double gy   = sP_(1);
             double gz   = sP_(2);
             double gz2  = gz*gz;
-            double fgz2 = cam->getFx() / std::max(Config::homogTh(),gz2);
+            double fgz2 = f / std::max(homog_th,gz2);
             double ds   = err_i(0);
             double de   = err_i(1);
             double lx   = l_obs(0);
@@ -585,7 +1012,7 @@ void StereoFrameHandler::optimizeFunctions_nonweighted(Matrix4d DT, Matrix6d &H,
             gy   = eP_(1);
             gz   = eP_(2);
             gz2  = gz*gz;
-            fgz2 = cam->getFx() / std::max(Config::homogTh(),gz2);
+            fgz2 = f / std::max(homog_th,gz2);
             Vector6d Je_aux, J_aux;
             Je_aux << + fgz2 * lx * gz,
                       + fgz2 * ly * gz,
@@ -594,91 +1021,53 @@ void StereoFrameHandler::optimizeFunctions_nonweighted(Matrix4d DT, Matrix6d &H,
                       + fgz2 * ( gx*gx*lx + gz*gz*lx + gx*gy*ly ),
                       + fgz2 * ( gx*gz*ly - gy*gz*lx );
             // jacobian
-            J_aux = ( Js_aux * ds + Je_aux * de ) / std::max(Config::homogTh(),err_i_norm);
+            J_aux = ( Js_aux * ds + Je_aux * de ) / std::max(homog_th,err_i_norm);
             // if employing robust cost function
             double w = 1.0;
-            if( Config::robustCost() )
+            if( P::robust )
                 w = 1.0 / ( 1.0 + err_i_norm * err_i_norm );
             // update hessian, gradient, and error
-            H_l += J_aux * J_aux.transpose() * w;
-            g_l += J_aux * err_i_norm * w;
-            e_l += err_i_norm * err_i_norm * w;
-            N_l++;
-            if( Config::scalePointsLines() )
-                r_l.push_back( err_i_norm * err_i_norm * w );
+            acc.H += J_aux * J_aux.transpose() * w;
+            acc.g += J_aux * err_i_norm * w;
+            acc.e += err_i_norm * err_i_norm * w;
+            acc.N++;
+            if( P::scale )
+                acc.r.push_back( err_i_norm * err_i_norm * w );
         }
-
-    }
-    if( Config::scalePointsLines() )
-        S_l = vector_stdv_mad(r_l);
-
-    // sum H, g and err from both points and lines
-    if( Config::scalePointsLines() && S_l > Config::homogTh() && S_p > Config::homogTh() &&
-        Config::hasPoints() && Config::hasLines() )
-    {
-        double S_l_inv = 1.0 / S_l;
-        double S_p_inv = 1.0 / S_p;
-        double S_l_ = (S_p_inv+S_l_inv) / S_p_inv;
-        double S_p_ = (S_p_inv+S_l_inv) / S_l_inv;
-        H = H_p * S_p_ + H_l * S_l_;
-        g = g_p * S_p_ + g_l * S_l_;
-        e = e_p * S_p_ + e_l * S_l_;
-    }
-    else
-    {
-        H = H_p + H_l;
-        g = g_p + g_l;
-        e = e_p + e_l;
     }
 
-    // normalize error
-    e /= (N_l+N_p);
-
 }
 
-void StereoFrameHandler::optimizeFunctions_uncweighted(Matrix4d DT, Matrix6d &H, Vector6d &g, double &e )
+template<class P>
+void StereoFrameHandler::pointCost_uncweighted(const Matrix4d &DT, int i0, int i1, CostAccumulator &acc )
 {
 
-    // define hessians, gradients, and residuals
-    Matrix6d H_l, H_p;
-    Vector6d g_l, g_p;
-    double   e_l = 0.0, e_p = 0.0, S_l, S_p;
-    H   = Matrix6d::Zero(); H_l = H; H_p = H;
-    g   = Vector6d::Zero(); g_l = g; g_p = g;
-    e   = 0.0;
-
     // assign cam parameters
-    double f     = cam->getFx();
-    double cx    = cam->getCx();
-    double cy    = cam->getCy();
-    double sigma = Config::sigmaPx();
+    const double f        = cam->getFx();
+    const double sigma    = Config::sigmaPx();
+    const double homog_th = Config::homogTh();
 
     // estimate sigma parameters
     double bsigma     = f * cam->getB() * sigma;
-    double bsigma_inv = 1.f / bsigma;
     double sigma2     = sigma * sigma;
+    Matrix3d R        = DT.block(0,0,3,3);
 
-    // point features
-    Matrix3d R  = DT.block(0,0,3,3);
-    int n_inliers_ = 0;
-    int N_p = 0;
-    vector<double> r_p;
-    for( list<PointFeature*>::iterator it = matched_pt.begin(); it!=matched_pt.end(); it++)
+    for( int i = i0; i < i1; i++ )
     {
-        if( (*it)->inlier )
+        if( matched.pt_inlier[i] )
         {
-            Vector3d P_ = R * (*it)->P + DT.col(3).head(3);
+            Vector3d P_ = R * Vector3d( matched.pt_X[i], matched.pt_Y[i], matched.pt_Z[i] ) + DT.col(3).head(3);
             Vector2d pl_proj = cam->projection( P_ );
             // projection error
-            Vector2d err_i    = pl_proj - (*it)->pl_obs;
+            Vector2d err_i    = pl_proj - Vector2d( matched.pt_u_obs[i], matched.pt_v_obs[i] );
             double err_i_norm = err_i.norm();
+            matched.pt_res[i] = err_i_norm;
             // estimate variables for J, H, and g
-            n_inliers_++;
             double gx   = P_(0);
             double gy   = P_(1);
             double gz   = P_(2);
             double gz2  = gz*gz;
-            double fgz2 = f / std::max(Config::homogTh(),gz2);
+            double fgz2 = f / std::max(homog_th,gz2);
             double dx   = err_i(0);
             double dy   = err_i(1);
             // jacobian
@@ -689,75 +1078,73 @@ void StereoFrameHandler::optimizeFunctions_uncweighted(Matrix4d DT, Matrix6d &H,
                      - fgz2 * ( gx*gy*dx + gy*gy*dy + gz*gz*dy ),
                      + fgz2 * ( gx*gx*dx + gz*gz*dx + gx*gy*dy ),
                      + fgz2 * ( gx*gz*dy - gy*gz*dx );
-            J_aux = J_aux / std::max(Config::homogTh(),err_i_norm);
-            // uncertainty
-            double px_hat = (*it)->pl(0) - cx;
-            double py_hat = (*it)->pl(1) - cy;
-            double disp   = (*it)->disp;
-            double disp2  = disp * disp;
-            Matrix3d covP_an;
-            covP_an(0,0) = disp2+2.f*px_hat*px_hat;
-            covP_an(0,1) = 2.f*px_hat*py_hat;
-            covP_an(0,2) = 2.f*f*px_hat;
-            covP_an(1,1) = disp2+2.f*py_hat*py_hat;
-            covP_an(1,2) = 2.f*f*py_hat;
-            covP_an(2,2) = 2.f*f*f;
-            covP_an(1,0) = covP_an(0,1);
-            covP_an(2,0) = covP_an(0,2);
-            covP_an(2,1) = covP_an(1,2);
-            covP_an << covP_an / (disp2*disp2);
-            MatrixXd Jhg(2,3), covp(2,2), covp_inv(2,2);
-            Jhg  << gz, 0.f, -gx, 0.f, gz, -gy;
-            Jhg  << Jhg * R;
-            covp << Jhg * covP_an * Jhg.transpose();
-            covp << covp / (gz2*gz2);
-            covp = bsigma * covp;
+            J_aux = J_aux / std::max(homog_th,err_i_norm);
+            // uncertainty (the covariance of the back-projected point is cached in the feature)
+            Matrix<double,2,3> Jhg;
+            Matrix2d covp;
+            Jhg  << gz, 0.0, -gx, 0.0, gz, -gy;
+            Jhg   = Jhg * R;
+            covp  = Jhg * matched.pt_cov[i] * Jhg.transpose();
+            covp  = covp * ( bsigma / (gz2*gz2) );
             covp(0,0) = covp(0,0) + sigma2;
             covp(1,1) = covp(1,1) + sigma2;
-            covp_inv = covp.inverse();
             // update the weights matrix
-            double wunc = err_i.transpose() * covp_inv * err_i;
+            double wunc = err_i.dot( covp.inverse() * err_i );
             wunc = wunc / (dx*dx+dy*dy);
             // if employing robust cost function
             double w = 1.0;
-            if( Config::robustCost() )
+            if( P::robust )
                 w = 1.0 / ( 1.0 + err_i_norm );
             // update hessian, gradient, and error
-            H_p += J_aux * J_aux.transpose() * wunc * w / err_i_norm ;
-            g_p += J_aux * w * wunc;
-            e_p += err_i_norm * err_i_norm * wunc * w ;
-            N_p++;
-            if( Config::scalePointsLines() )
-                r_p.push_back( err_i_norm * err_i_norm * w * wunc );
+            acc.H += J_aux * J_aux.transpose() * wunc * w / err_i_norm ;
+            acc.g += J_aux * w * wunc;
+            acc.e += err_i_norm * err_i_norm * wunc * w ;
+            acc.N++;
+            if( P::scale )
+                acc.r.push_back( err_i_norm * err_i_norm * w * wunc );
         }
     }
-    if( Config::scalePointsLines() )
-        S_p = vector_stdv_mad(r_p);
 
-    // line segment features
-    int N_l = 0;
-    vector<double> r_l;
-    for( list<LineFeature*>::iterator it = matched_ls.begin(); it!=matched_ls.end(); it++)
+}
+
+template<class P>
+void StereoFrameHandler::lineCost_uncweighted(const Matrix4d &DT, int i0, int i1, CostAccumulator &acc )
+{
+
+    // assign cam parameters
+    const double f        = cam->getFx();
+    const double cx       = cam->getCx();
+    const double cy       = cam->getCy();
+    const double sigma    = Config::sigmaPx();
+    const double homog_th = Config::homogTh();
+
+    // estimate sigma parameters
+    double bsigma     = f * cam->getB() * sigma;
+    double bsigma_inv = 1.f / bsigma;
+    Matrix3d R        = DT.block(0,0,3,3);
+
+    for( int i = i0; i < i1; i++ )
     {
-        if( (*it)->inlier )
+        if( matched.ls_inlier[i] )
         {
-            Vector3d sP_ = DT.block(0,0,3,3) * (*it)->sP + DT.col(3).head(3);
+            Vector3d sP_ = DT.block(0,0,3,3) * Vector3d( matched.ls_sX[i], matched.ls_sY[i], matched.ls_sZ[i] ) + DT.col(3).head(3);
             Vector2d spl_proj = cam->projection( sP_ );
-            Vector3d eP_ = DT.block(0,0,3,3) * (*it)->eP + DT.col(3).head(3);
+            Vector3d eP_ = DT.block(0,0,3,3) * Vector3d( matched.ls_eX[i], matched.ls_eY[i], matched.ls_eZ[i] ) + DT.col(3).head(3);
             Vector2d epl_proj = cam->projection( eP_ );
-            Vector3d l_obs = (*it)->le_obs;
+            Vector3d l_obs = Vector3d( matched.ls_lx[i], matched.ls_ly[i], matched.ls_lz[i] );
             // projection error
             Vector2d err_i;
             err_i(0) = l_obs(0) * spl_proj(0) + l_obs(1) * spl_proj(1) + l_obs(2);
             err_i(1) = l_obs(0) * epl_proj(0) + l_obs(1) * epl_proj(1) + l_obs(2);
             double err_i_norm = err_i.norm();
+            matched.ls_res[i] = err_i_norm;
             // estimate variables for J, H, and g
             // -- start point
             double gx   = sP_(0);
             double gy   = sP_(1);
             double gz   = sP_(2);
             double gz2  = gz*gz;
-            double fgz2 = f / std::max(Config::homogTh(),gz2);
+            double fgz2 = f / std::max(homog_th,gz2);
             double ds   = err_i(0);
             double de   = err_i(1);
             double lx   = l_obs(0);
@@ -769,33 +1156,17 @@ void StereoFrameHandler::optimizeFunctions_uncweighted(Matrix4d DT, Matrix6d &H,
                       - fgz2 * ( gx*gy*lx + gy*gy*ly + gz*gz*ly ),
                       + fgz2 * ( gx*gx*lx + gz*gz*lx + gx*gy*ly ),
                       + fgz2 * ( gx*gz*ly - gy*gz*lx );
-            // uncertainty
-            double px_hat = (*it)->spl(0) - cx;
-            double py_hat = (*it)->spl(1) - cy;
-            double disp   = (*it)->sdisp;
-            double disp2  = disp * disp;
-            Matrix3d covP_an;
-            covP_an(0,0) = disp2+2.f*px_hat*px_hat;
-            covP_an(0,1) = 2.f*px_hat*py_hat;
-            covP_an(0,2) = 2.f*f*px_hat;
-            covP_an(1,1) = disp2+2.f*py_hat*py_hat;
-            covP_an(1,2) = 2.f*f*py_hat;
-            covP_an(2,2) = 2.f*f*f;
-            covP_an(1,0) = covP_an(0,1);
-            covP_an(2,0) = covP_an(0,2);
-            covP_an(2,1) = covP_an(1,2);
-            covP_an << covP_an / (disp2*disp2);
+            // uncertainty (the covariances of the back-projected endpoints are cached in the feature)
             Vector3d spl_proj_ = cam->projectionNH( sP_ );
-            MatrixXd J_ep(1,3);
+            RowVector3d J_ep;
             double lxpz = lx * spl_proj_(2);
             double lypz = ly * spl_proj_(2);
             J_ep << lxpz*f, lypz*f, lxpz*cx+lypz*cy-lx*spl_proj_(0)-ly*spl_proj_(1);
-            J_ep << J_ep * R;
-            double p4 = pow(spl_proj_(2),4);
+            J_ep  = J_ep * R;
+            double p2 = spl_proj_(2) * spl_proj_(2);
+            double p4 = p2 * p2;
             double cov_p;
-            VectorXd cov_aux(1);
-            cov_aux << J_ep * covP_an * J_ep.transpose();
-            cov_p = cov_aux(0);
+            cov_p = J_ep.dot( matched.ls_scov[i] * J_ep.transpose() );
             cov_p = 1.f/cov_p;
             cov_p = p4 * cov_p * 0.5f * bsigma_inv;
             // -- end point
@@ -803,7 +1174,7 @@ void StereoFrameHandler::optimizeFunctions_uncweighted(Matrix4d DT, Matrix6d &H,
             gy   = eP_(1);
             gz   = eP_(2);
             gz2  = gz*gz;
-            fgz2 = cam->getFx() / std::max(Config::homogTh(),gz2);
+            fgz2 = f / std::max(homog_th,gz2);
             Vector6d Je_aux, J_aux;
             Je_aux << + fgz2 * lx * gz,
                       + fgz2 * ly * gz,
@@ -812,82 +1183,41 @@ void StereoFrameHandler::optimizeFunctions_uncweighted(Matrix4d DT, Matrix6d &H,
                       + fgz2 * ( gx*gx*lx + gz*gz*lx + gx*gy*ly ),
                       + fgz2 * ( gx*gz*ly - gy*gz*lx );
             // uncertainty
-            px_hat = (*it)->epl(0) - cx;
-            py_hat = (*it)->epl(1) - cy;
-            disp   = (*it)->edisp;
-            disp2  = disp * disp;
-            Matrix3d covQ_an;
-            covQ_an(0,0) = disp2+2.f*px_hat*px_hat;
-            covQ_an(0,1) = 2.f*px_hat*py_hat;
-            covQ_an(0,2) = 2.f*f*px_hat;
-            covQ_an(1,1) = disp2+2.f*py_hat*py_hat;
-            covQ_an(1,2) = 2.f*f*py_hat;
-            covQ_an(2,2) = 2.f*f*f;
-            covQ_an(1,0) = covQ_an(0,1);
-            covQ_an(2,0) = covQ_an(0,2);
-            covQ_an(2,1) = covQ_an(1,2);
-            covQ_an << covQ_an / (disp2*disp2);
             Vector3d epl_proj_ = cam->projectionNH( eP_ );
             lxpz = lx * epl_proj_(2);
             lypz = ly * epl_proj_(2);
             J_ep << lxpz*f, lypz*f, lxpz*cx+lypz*cy-lx*epl_proj_(0)-ly*epl_proj_(1);
-            J_ep << J_ep * R;
-            p4 = pow(epl_proj_(2),4);
+            J_ep  = J_ep * R;
+            p2 = epl_proj_(2) * epl_proj_(2);
+            p4 = p2 * p2;
             double cov_q;
-            cov_aux << J_ep * covQ_an * J_ep.transpose();
-            cov_q = cov_aux(0);
+            cov_q = J_ep.dot( matched.ls_ecov[i] * J_ep.transpose() );
             cov_q = 1.f / cov_q;
             cov_q = p4 * cov_q * 0.5f * bsigma_inv;
             if( !std::isinf(cov_p) && !std::isnan(cov_p) && !std::isinf(cov_q) && !std::isnan(cov_q) )
             {
-                n_inliers_++;
                 // update the weights matrix
                 double wunc = err_i(0) * err_i(0) * cov_p + err_i(1) * err_i(1) * cov_q;
                 wunc = wunc / ( err_i(0)*err_i(0) + err_i(1)*err_i(1) );
                 // jacobian
-                J_aux = ( Js_aux * ds + Je_aux * de ) / std::max(Config::homogTh(),err_i_norm);
+                J_aux = ( Js_aux * ds + Je_aux * de ) / std::max(homog_th,err_i_norm);
                 // if employing robust cost function
                 double w = 1.0;
-                if( Config::robustCost() )
+                if( P::robust )
                     w = 1.0 / ( 1.0 + err_i_norm );
                 // update hessian, gradient, and error
-                H_l += J_aux * J_aux.transpose() * wunc * w / err_i_norm ;
-                g_l += J_aux * w * wunc;
-                e_l += err_i_norm * err_i_norm * wunc * w ;
-                N_l++;
-                if( Config::scalePointsLines() )
-                    r_l.push_back( err_i_norm * err_i_norm * w * wunc );
+                acc.H += J_aux * J_aux.transpose() * wunc * w / err_i_norm ;
+                acc.g += J_aux * w * wunc;
+                acc.e += err_i_norm * err_i_norm * wunc * w ;
+                acc.N++;
+                if( P::scale )
+                    acc.r.push_back( err_i_norm * err_i_norm * w * wunc );
             }
             else
-                (*it)->inlier = false;
+                matched.ls_inlier[i] = false;
         }
 
     }
-    if( Config::scalePointsLines() )
-        S_l = vector_stdv_mad(r_l);
-
-    // sum H, g and err from both points and lines
-    if( Config::scalePointsLines() && S_l > Config::homogTh() && S_p > Config::homogTh() &&
-        Config::hasPoints() && Config::hasLines() )
-    {
-        double S_l_inv = 1.0 / S_l;
-        double S_p_inv = 1.0 / S_p;
-        double S_l_ = (S_p_inv+S_l_inv) / S_p_inv;
-        double S_p_ = (S_p_inv+S_l_inv) / S_l_inv;
-        H = H_p * S_p_ + H_l * S_l_;
-        g = g_p * S_p_ + g_l * S_l_;
-        e = e_p * S_p_ + e_l * S_l_;
-    }
-    else
-    {
-        H = H_p + H_l;
-        g = g_p + g_l;
-        e = e_p + e_l;
-    }
-
-    // normalize error
-    e /= (N_l+N_p);
-
 
 }
 
@@ -0,0 +1,97 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#include <stereoImageReader.h>
+
+namespace StVO{
+
+StereoImageReader::StereoImageReader( const vector<string> &paths_l_, const vector<string> &paths_r_, PinholeStereoCamera *cam_, int n_buffers_, int n_threads_ ) :
+    paths_l(paths_l_), paths_r(paths_r_), cam(cam_), ring( max(1,n_buffers_) ), next_read(0), next_out(0), stop(false)
+{
+    n_pairs = min( paths_l.size(), paths_r.size() );
+    for( int i = 0; i < ring.size(); i++ )
+        ring[i].ready = false;
+    for( int i = 0; i < max(1,n_threads_); i++ )
+        readers.push_back( thread( &StereoImageReader::readerLoop, this ) );
+}
+
+StereoImageReader::~StereoImageReader()
+{
+    {
+        lock_guard<mutex> lock(mtx);
+        stop = true;
+    }
+    slot_free.notify_all();
+    for( int i = 0; i < readers.size(); i++ )
+        readers[i].join();
+}
+
+bool StereoImageReader::nextStereoPair( Mat &img_l, Mat &img_r )
+{
+    unique_lock<mutex> lock(mtx);
+    if( next_out >= n_pairs )
+        return false;
+    StereoPair &slot = ring[ next_out % ring.size() ];
+    slot_ready.wait( lock, [&slot]{ return slot.ready; } );
+    img_l = slot.img_l;
+    img_r = slot.img_r;
+    // the tracker keeps the only reference to the images, the slot is free for the next pairs
+    slot.img_l.release();
+    slot.img_r.release();
+    slot.ready = false;
+    next_out++;
+    slot_free.notify_all();
+    return true;
+}
+
+void StereoImageReader::readerLoop()
+{
+    while( true )
+    {
+        // claim the next pair as soon as its slot in the ring has been released by the tracker
+        int idx;
+        {
+            unique_lock<mutex> lock(mtx);
+            slot_free.wait( lock, [this]{ return stop || next_read >= n_pairs || next_read < next_out + int(ring.size()); } );
+            if( stop || next_read >= n_pairs )
+                return;
+            idx = next_read++;
+        }
+
+        // decode and rectify out of the lock
+        Mat img_l( imread(paths_l[idx], CV_LOAD_IMAGE_UNCHANGED) );
+        Mat img_r( imread(paths_r[idx], CV_LOAD_IMAGE_UNCHANGED) );
+        Mat img_l_rec, img_r_rec;
+        if( !img_l.empty() && !img_r.empty() )
+            cam->rectifyImagesLR( img_l, img_l_rec, img_r, img_r_rec );
+
+        {
+            lock_guard<mutex> lock(mtx);
+            StereoPair &slot = ring[ idx % ring.size() ];
+            slot.img_l = img_l_rec;
+            slot.img_r = img_r_rec;
+            slot.ready = true;
+        }
+        slot_ready.notify_all();
+    }
+}
+
+}
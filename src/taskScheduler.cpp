@@ -0,0 +1,214 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+#include <taskScheduler.h>
+#include <config.h>
+
+namespace StVO{
+
+// index of the deque owned by the current thread (-1 if it is not a worker)
+static thread_local int local_queue = -1;
+
+TaskScheduler& TaskScheduler::getInstance()
+{
+    static TaskScheduler instance( Config::numThreads() ); // Instantiated on first use and guaranteed to be destroyed
+    return instance;
+}
+
+TaskScheduler::TaskScheduler( int n_workers ) : n_pending(0), next_queue(0), stop(false)
+{
+    n_workers = max( 1, n_workers );
+    for( int i = 0; i < n_workers; i++ )
+        queues.push_back( unique_ptr<WorkQueue>( new WorkQueue() ) );
+    for( int i = 0; i < n_workers; i++ )
+        workers.push_back( thread( &TaskScheduler::workerLoop, this, i ) );
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        lock_guard<mutex> lock(wake_mtx);
+        stop = true;
+    }
+    wake_cv.notify_all();
+    for( int i = 0; i < workers.size(); i++ )
+        workers[i].join();
+}
+
+void TaskScheduler::submit( function<void()> task )
+{
+    // tasks spawned by a worker stay in its own deque (LIFO), the rest are spread round-robin
+    int idx = local_queue;
+    if( idx < 0 )
+        idx = next_queue++ % queues.size();
+    {
+        lock_guard<mutex> lock(queues[idx]->mtx);
+        queues[idx]->tasks.push_back( std::move(task) );
+    }
+    {
+        lock_guard<mutex> lock(wake_mtx);
+        n_pending++;
+    }
+    wake_cv.notify_one();
+}
+
+bool TaskScheduler::runPendingTask()
+{
+    function<void()> task;
+    if( !popTask( local_queue, task ) )
+        return false;
+    task();
+    return true;
+}
+
+void TaskScheduler::workerLoop( int idx )
+{
+    local_queue = idx;
+    function<void()> task;
+    while( true )
+    {
+        if( popTask( idx, task ) )
+        {
+            task();
+            task = nullptr;
+            continue;
+        }
+        unique_lock<mutex> lock(wake_mtx);
+        wake_cv.wait( lock, [this]{ return stop || n_pending > 0; } );
+        if( stop && n_pending == 0 )
+            return;
+    }
+}
+
+bool TaskScheduler::popTask( int idx, function<void()> &task )
+{
+    // own deque first (newest task, still hot in cache)
+    if( idx >= 0 )
+    {
+        lock_guard<mutex> lock(queues[idx]->mtx);
+        if( !queues[idx]->tasks.empty() )
+        {
+            task = std::move( queues[idx]->tasks.back() );
+            queues[idx]->tasks.pop_back();
+            n_pending--;
+            return true;
+        }
+    }
+    // steal the oldest task from the other deques
+    int n_queues = queues.size();
+    int start    = ( idx >= 0 ) ? idx + 1 : 0;
+    for( int i = 0; i < n_queues; i++ )
+    {
+        int victim = ( start + i ) % n_queues;
+        if( victim == idx )
+            continue;
+        lock_guard<mutex> lock(queues[victim]->mtx);
+        if( !queues[victim]->tasks.empty() )
+        {
+            task = std::move( queues[victim]->tasks.front() );
+            queues[victim]->tasks.pop_front();
+            n_pending--;
+            return true;
+        }
+    }
+    return false;
+}
+
+TaskGraph::TaskGraph() : n_remaining(0) {}
+
+TaskGraph::~TaskGraph(){}
+
+TaskGraph::TaskId TaskGraph::addTask( function<void()> fn, const vector<TaskId> &deps )
+{
+    TaskId id = nodes.size();
+    Node* node = new Node();
+    node->fn     = fn;
+    node->n_deps = deps.size();
+    for( int i = 0; i < deps.size(); i++ )
+        nodes[deps[i]]->successors.push_back( id );
+    nodes.push_back( unique_ptr<Node>(node) );
+    return id;
+}
+
+void TaskGraph::run( bool parallel )
+{
+
+    // serial execution: the insertion order already respects the dependencies
+    if( !parallel )
+    {
+        for( int i = 0; i < nodes.size(); i++ )
+            nodes[i]->fn();
+        return;
+    }
+
+    n_remaining = nodes.size();
+    for( int i = 0; i < nodes.size(); i++ )
+        nodes[i]->n_waiting = nodes[i]->n_deps;
+    for( int i = 0; i < nodes.size(); i++ )
+    {
+        if( nodes[i]->n_deps == 0 )
+            launch( i );
+    }
+
+    // the calling thread helps with the queued tasks instead of blocking a worker
+    TaskScheduler& scheduler = TaskScheduler::getInstance();
+    while( n_remaining > 0 )
+    {
+        if( scheduler.runPendingTask() )
+            continue;
+        unique_lock<mutex> lock(done_mtx);
+        done_cv.wait_for( lock, chrono::microseconds(100), [this]{ return n_remaining == 0; } );
+    }
+    // the last task may still be holding the lock while notifying
+    lock_guard<mutex> lock(done_mtx);
+
+}
+
+int TaskGraph::threadShare( int n_tasks, bool parallel )
+{
+    // an even share of the threads of the scheduler, so that nested loops do not oversubscribe it
+    int n_threads = max( 1, Config::numThreads() );
+    if( !parallel )
+        return n_threads;
+    return max( 1, n_threads / max( 1, n_tasks ) );
+}
+
+void TaskGraph::launch( TaskId id )
+{
+    TaskScheduler::getInstance().submit( bind( &TaskGraph::execute, this, id ) );
+}
+
+void TaskGraph::execute( TaskId id )
+{
+    nodes[id]->fn();
+    // release the successors whose dependencies are now complete
+    for( int i = 0; i < nodes[id]->successors.size(); i++ )
+    {
+        TaskId next = nodes[id]->successors[i];
+        if( --nodes[next]->n_waiting == 0 )
+            launch( next );
+    }
+    lock_guard<mutex> lock(done_mtx);
+    if( --n_remaining == 0 )
+        done_cv.notify_all();
+}
+
+}
@@ -0,0 +1,117 @@
+/*****************************************************************************
+**   Stereo Visual Odometry by combining point and line segment features	**
+******************************************************************************
+**																			**
+**	Copyright(c) 2016, Ruben Gomez-Ojeda, University of Malaga              **
+**	Copyright(c) 2016, MAPIR group, University of Malaga					**
+**																			**
+**  This program is free software: you can redistribute it and/or modify	**
+**  it under the terms of the GNU General Public License (version 3) as		**
+**	published by the Free Software Foundation.								**
+**																			**
+**  This program is distributed in the hope that it will be useful, but		**
+**	WITHOUT ANY WARRANTY; without even the implied warranty of				**
+**  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the			**
+**  GNU General Public License for more details.							**
+**																			**
+**  You should have received a copy of the GNU General Public License		**
+**  along with this program.  If not, see <http://www.gnu.org/licenses/>.	**
+**																			**
+*****************************************************************************/
+
+// Equivalence of HammingMatcher with BFMatcher(NORM_HAMMING): the same matches, distances and order
+// of the ties (the lowest index first) for knnMatch, knnMatchBidirectional (serial and parallel) and
+// knnMatchCandidates (against a masked BFMatcher). The descriptors are random perturbations of a few
+// seeds, with exact duplicates, so that most of the distances are tied.
+
+#include <hammingMatcher.h>
+#include <iostream>
+
+using namespace StVO;
+
+static Mat randomDescriptors( RNG &rng, const Mat &seeds, int n )
+{
+    Mat desc( n, seeds.cols, CV_8UC1 );
+    for( int i = 0; i < n; i++ )
+    {
+        seeds.row( rng.uniform( 0, seeds.rows ) ).copyTo( desc.row(i) );
+        int n_flips = rng.uniform( 0, 4 );
+        for( int f = 0; f < n_flips; f++ )
+            desc.at<uchar>( i, rng.uniform( 0, desc.cols ) ) ^= uchar( 1 << rng.uniform( 0, 8 ) );
+    }
+    return desc;
+}
+
+static bool sameMatches( const vector<vector<DMatch>> &m, const vector<vector<DMatch>> &m_ref, const string &name )
+{
+    bool same = ( m.size() == m_ref.size() );
+    for( size_t i = 0; same && i < m.size(); i++ )
+    {
+        same = ( m[i].size() == m_ref[i].size() );
+        for( size_t r = 0; same && r < m[i].size(); r++ )
+            same = m[i][r].queryIdx == m_ref[i][r].queryIdx && m[i][r].trainIdx == m_ref[i][r].trainIdx &&
+                   m[i][r].distance == m_ref[i][r].distance;
+        if( !same )
+            cout << name << ": different matches for descriptor " << i << endl;
+    }
+    if( m.size() != m_ref.size() )
+        cout << name << ": " << m.size() << " rows instead of " << m_ref.size() << endl;
+    return same;
+}
+
+int main()
+{
+
+    RNG rng( 0x5eed );
+    BFMatcher bfm( NORM_HAMMING, false );
+    bool ok = true;
+    for( int trial = 0; trial < 20; trial++ )
+    {
+        // 256-bit descriptors (packed SIMD path) and a generic length (BRISK-like, 64 bytes)
+        int n_bytes = ( trial % 4 == 3 ) ? 64 : 32;
+        Mat seeds( 8, n_bytes, CV_8UC1 );
+        rng.fill( seeds, RNG::UNIFORM, 0, 256 );
+        Mat desc_1 = randomDescriptors( rng, seeds, rng.uniform( 1, 700 ) );
+        Mat desc_2 = randomDescriptors( rng, seeds, rng.uniform( 1, 700 ) );
+        int k = 1 + trial % 3;
+
+        vector<vector<DMatch>> ref_12, ref_21, m_12, m_21;
+        bfm.knnMatch( desc_1, desc_2, ref_12, k );
+        bfm.knnMatch( desc_2, desc_1, ref_21, k );
+        if( HammingMatcher::isSupported( desc_1 ) )
+        {
+            HammingMatcher::knnMatch( desc_1, desc_2, m_12, k );
+            ok &= sameMatches( m_12, ref_12, "knnMatch" );
+        }
+        HammingMatcher::knnMatchBidirectional( desc_1, desc_2, m_12, m_21, k, false );
+        ok &= sameMatches( m_12, ref_12, "knnMatchBidirectional 12" );
+        ok &= sameMatches( m_21, ref_21, "knnMatchBidirectional 21" );
+        HammingMatcher::knnMatchBidirectional( desc_1, desc_2, m_12, m_21, k, true );
+        ok &= sameMatches( m_12, ref_12, "knnMatchBidirectional (parallel) 12" );
+        ok &= sameMatches( m_21, ref_21, "knnMatchBidirectional (parallel) 21" );
+
+        // sorted candidates, the same pairs as the mask of the reference
+        vector<vector<int>> candidates( desc_1.rows );
+        Mat mask = Mat::zeros( desc_1.rows, desc_2.rows, CV_8UC1 );
+        for( int i = 0; i < desc_1.rows; i++ )
+        {
+            for( int j = 0; j < desc_2.rows; j++ )
+            {
+                if( rng.uniform( 0, 4 ) == 0 )
+                {
+                    candidates[i].push_back( j );
+                    mask.at<uchar>( i, j ) = 1;
+                }
+            }
+        }
+        bfm.knnMatch( desc_1, desc_2, ref_12, k, mask );
+        bfm.knnMatch( desc_2, desc_1, ref_21, k, Mat( mask.t() ) );
+        HammingMatcher::knnMatchCandidates( desc_1, desc_2, candidates, m_12, m_21, k );
+        ok &= sameMatches( m_12, ref_12, "knnMatchCandidates 12" );
+        ok &= sameMatches( m_21, ref_21, "knnMatchCandidates 21" );
+    }
+
+    cout << ( ok ? "HammingMatcher matches BFMatcher" : "HammingMatcher differs from BFMatcher" ) << endl;
+    return ok ? 0 : 1;
+
+}